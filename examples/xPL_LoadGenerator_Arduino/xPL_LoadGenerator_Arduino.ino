@@ -0,0 +1,276 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include <SPI.h>        
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+#include "xPL.h"
+
+// Load generator for stress testing an xPL receiver/gateway
+// - sends a mix of hbeat.app, sensor.basic, x10.basic and lighting.basic messages
+//   from SOURCES_COUNT simulated sources, at RATE_PER_SECOND, by bursts of BURST_LENGTH
+// - MALFORMED_PERCENT of the messages are corrupted on purpose
+// - every PROBE_INTERVAL ms a config.current request is sent to the receiver (any device
+//   built on this library without XPL_NO_CONFIG answers it) to measure round trip latency
+//   and loss. Unlike its heartbeat, the config.current stat is only sent as an answer.
+// - statistics are printed on the serial port every REPORT_INTERVAL ms
+
+#define SOURCES_COUNT        2000
+#define RATE_PER_SECOND      100
+#define BURST_LENGTH         10       // 1 = evenly spaced messages
+#define MALFORMED_PERCENT    2
+
+// message mix, in percent
+#define MIX_HBEAT            10
+#define MIX_SENSOR           50
+#define MIX_X10              20
+#define MIX_LIGHTING         20
+
+#define PROBE_INTERVAL       1000
+#define PROBE_TIMEOUT        500
+#define REPORT_INTERVAL      5000
+
+// receiver under test
+#define RECEIVER_VENDOR      "xpl"
+#define RECEIVER_DEVICE      "arduino"
+#define RECEIVER_INSTANCE    "test"
+
+xPL xpl;
+
+// Enter a MAC address and IP address for your controller below.
+// The IP address will be dependent on your local network:
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xEE };
+IPAddress ip(10, 0, 0, 178);
+IPAddress broadcast(10, 0, 0, 255);
+EthernetUDP Udp;
+
+unsigned long burst_timer = 0;
+unsigned long probe_timer = 0;
+unsigned long report_timer = 0;
+bool probe_pending = false;
+
+// statistics
+unsigned long sent = 0;
+unsigned long malformed = 0;
+unsigned long probes = 0;
+unsigned long probes_lost = 0;
+unsigned long rtt_total = 0;
+unsigned long rtt_max = 0;
+
+void SendUdPMessage(char *buffer)
+{
+    Udp.beginPacket(broadcast, xpl.udp_port);
+    Udp.write(buffer);
+    Udp.endPacket(); 
+}
+
+void AfterParseAction(xPL_Message * message)
+{
+  // config.current of the receiver = answer to our probe
+  if (probe_pending
+      && message->type == XPL_STAT
+      && strcmp_P(message->source.vendor_id, PSTR(RECEIVER_VENDOR)) == 0
+      && strcmp_P(message->source.device_id, PSTR(RECEIVER_DEVICE)) == 0
+      && strcmp_P(message->source.instance_id, PSTR(RECEIVER_INSTANCE)) == 0
+      && message->IsSchema_P(PSTR("config"), PSTR("current")))
+  {
+    unsigned long rtt = millis() - probe_timer;
+    rtt_total += rtt;
+    if (rtt > rtt_max) rtt_max = rtt;
+    probe_pending = false;
+  }
+}
+
+void AddValue(xPL_Message *msg, const PROGMEM char *name, long value)
+{
+  struct_command cmd;
+  strcpy_P(cmd.name, name);
+  sprintf_P(cmd.value, PSTR("%ld"), value);
+  msg->AddCommand(cmd.name, cmd.value);
+}
+
+void SendRandomMessage()
+{
+  xPL_Message msg;
+  char vendor[XPL_VENDOR_ID_MAX+1] = "sim";
+  char device[XPL_DEVICE_ID_MAX+1] = "node";
+  char instance[XPL_INSTANCE_ID_MAX+1];
+  char buffer[XPL_MESSAGE_BUFFER_MAX];
+  long source = random(SOURCES_COUNT);
+  long mix = random(100);
+
+  sprintf_P(instance, PSTR("n%ld"), source);
+  msg.SetSource(vendor, device, instance);
+  msg.SetTarget_P(PSTR("*"));
+  msg.hop = 1;
+
+  if (mix < MIX_HBEAT)
+  {
+    msg.type = XPL_STAT;
+    msg.SetSchema_P(PSTR("hbeat"), PSTR("app"));
+    AddValue(&msg, PSTR("interval"), 5);
+    AddValue(&msg, PSTR("port"), XPL_UDP_PORT);
+  }
+  else if (mix < MIX_HBEAT + MIX_SENSOR)
+  {
+    msg.type = XPL_TRIG;
+    msg.SetSchema_P(PSTR("sensor"), PSTR("basic"));
+    AddValue(&msg, PSTR("device"), random(8));
+    msg.AddCommand_P(PSTR("type"), PSTR("temp"));
+    AddValue(&msg, PSTR("current"), random(-20, 40));
+  }
+  else if (mix < MIX_HBEAT + MIX_SENSOR + MIX_X10)
+  {
+    msg.type = XPL_TRIG;
+    msg.SetSchema_P(PSTR("x10"), PSTR("basic"));
+    struct_command cmd;
+    msg.AddCommand_P(PSTR("command"), random(2) ? PSTR("on") : PSTR("off"));
+    strcpy_P(cmd.name, PSTR("device"));
+    sprintf_P(cmd.value, PSTR("%c%ld"), (char)('a' + random(16)), random(1, 17));
+    msg.AddCommand(cmd.name, cmd.value);
+  }
+  else
+  {
+    msg.type = XPL_CMND;
+    msg.SetSchema_P(PSTR("lighting"), PSTR("basic"));
+    msg.AddCommand_P(PSTR("command"), PSTR("goto"));
+    AddValue(&msg, PSTR("network"), 1);
+    AddValue(&msg, PSTR("device"), random(64));
+    AddValue(&msg, PSTR("level"), random(101));
+  }
+
+  msg.toString(buffer);
+
+  if (random(100) < MALFORMED_PERCENT)
+  {
+    if (random(2))
+    {
+      *strchr(buffer, '{') = '[';      // broken header
+    }
+    else
+    {
+      buffer[strlen(buffer) / 2] = '\0';  // truncated datagram
+    }
+    malformed++;
+  }
+
+  xpl.SendMessage(buffer);
+  sent++;
+}
+
+void SendProbe()
+{
+  xPL_Message msg;
+
+  msg.hop = 1;
+  msg.type = XPL_CMND;
+  msg.SetTarget_P(PSTR(RECEIVER_VENDOR), PSTR(RECEIVER_DEVICE), PSTR(RECEIVER_INSTANCE));
+  msg.SetSchema_P(PSTR("config"), PSTR("current"));
+  msg.AddCommand_P(PSTR("command"), PSTR("request"));
+
+  xpl.SendMessage(&msg);
+
+  probes++;
+  probe_pending = true;
+  probe_timer = millis();
+}
+
+void Report()
+{
+  unsigned long answered = probes - probes_lost - (probe_pending ? 1 : 0);
+
+  Serial.print(F("sent="));
+  Serial.print(sent);
+  Serial.print(F(" malformed="));
+  Serial.print(malformed);
+  Serial.print(F(" probes="));
+  Serial.print(probes);
+  Serial.print(F(" lost="));
+  Serial.print(probes_lost);
+  Serial.print(F(" rtt_avg="));
+  Serial.print(answered ? rtt_total / answered : 0);
+  Serial.print(F("ms rtt_max="));
+  Serial.print(rtt_max);
+  Serial.println(F("ms"));
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Ethernet.begin(mac,ip);
+  Udp.begin(xpl.udp_port);  
+  
+  xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback
+  xpl.AfterParseAction = &AfterParseAction;  // pointer to a post parsing action callback 
+  xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("load")); // parameters for hearbeat message
+}
+
+void loop()
+{
+  xpl.Process();  // heartbeat management
+
+  // sending bursts of BURST_LENGTH messages to match RATE_PER_SECOND
+  if ((millis()-burst_timer) >= 1000UL * BURST_LENGTH / RATE_PER_SECOND)
+  {
+    burst_timer = millis();
+    for (byte i = 0; i < BURST_LENGTH; i++)
+    {
+      SendRandomMessage();
+    }
+  }
+
+  // latency / loss probe
+  if (probe_pending && (millis()-probe_timer) >= PROBE_TIMEOUT)
+  {
+    probe_pending = false;
+    probes_lost++;
+  }
+
+  if ((millis()-probe_timer) >= PROBE_INTERVAL)
+  {
+    SendProbe();
+  }
+
+  if ((millis()-report_timer) >= REPORT_INTERVAL)
+  {
+    Report();
+    report_timer = millis();
+  }
+
+  int packetSize = Udp.parsePacket();
+  if(packetSize)
+  {
+  	char xPLMessageBuff[XPL_MESSAGE_BUFFER_MAX];
+    
+    // read the packet into packetBufffer
+    Udp.read(xPLMessageBuff, XPL_MESSAGE_BUFFER_MAX);        
+    
+    // parse message
+    xpl.ParseInputMessage(xPLMessageBuff);
+  }
+}
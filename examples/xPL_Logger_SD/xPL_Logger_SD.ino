@@ -0,0 +1,344 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include <SPI.h>        
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <SD.h>
+
+#include "xPL.h"
+#include "xPL_Log.h"
+
+// Log of the xPL traffic on the SD card of the Ethernet shield
+// - each message is appended as a binary record with its time (see xPL_Log.h), the time
+//   is in ms of logging, continued after a reboot from the last record
+// - the log is split in segments, XPL00000.LOG, XPL00001.LOG... of SEGMENT_SIZE bytes
+// - a sparse index, XPL00000.IDX..., has one entry for every block of INDEX_EVERY records,
+//   so the reader only reads the blocks that may contain the wanted time/source/schema
+// - the files can be read on a computer with xPL_Log and xPL_Message
+// - send "p" on the serial port to print the messages of the last minute,
+//   "p <instance>" to print the messages of a source only,
+//   "s <class>" to print the messages of a schema class only (sensor, x10...)
+// - needs an Arduino Mega: SD + Ethernet libraries and the record buffers do not fit in 2KB of RAM
+
+#define SD_CS_PIN           4
+#define SEGMENT_SIZE        1048576UL
+#define INDEX_EVERY         32
+#define FLUSH_INTERVAL      1000
+#define PRINT_PERIOD        60000UL
+#define RECORD_MAX          XPL_MESSAGE_BUFFER_MAX
+
+xPL xpl;
+
+// Enter a MAC address and IP address for your controller below.
+// The IP address will be dependent on your local network:
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+IPAddress ip(10, 0, 0, 177);
+IPAddress broadcast(10, 0, 0, 255);
+EthernetUDP Udp;
+
+File logFile;
+File indexFile;
+word segment = 0;
+byte recordsInBlock = 0;
+struct_xpl_log_index block;
+unsigned long time_base = 0;  // time of the log when millis() was 0
+unsigned long flush_timer = 0;
+
+char serialBuff[XPL_INSTANCE_ID_MAX + 3];
+byte serialLength = 0;
+
+void SendUdPMessage(char *buffer)
+{
+    Udp.beginPacket(broadcast, xpl.udp_port);
+    Udp.write(buffer);
+    Udp.endPacket(); 
+}
+
+// time of the log, always increasing, even across reboots (millis() restarts from 0)
+unsigned long LogTime()
+{
+  return time_base + millis();
+}
+
+// read the next record of 'file', false at the end of the file or of a broken record
+bool ReadRecord(File &file, uint32_t *time, byte *record, uint16_t *length)
+{
+  byte header[XPL_LOG_RECORD_HEADER];
+
+  if (file.read(header, sizeof(header)) != sizeof(header))
+    return false;
+
+  logReadRecordHeader(header, time, length);
+  return *length <= RECORD_MAX && file.read(record, *length) == *length;
+}
+
+// read the next entry of 'file', false at the end of the file
+bool ReadIndex(File &file, struct_xpl_log_index *entry)
+{
+  byte data[XPL_LOG_INDEX_ENTRY];
+
+  if (file.read(data, sizeof(data)) != sizeof(data))
+    return false;
+
+  logReadIndex(data, entry);
+  return true;
+}
+
+void SegmentName(char *name, word number, const char *extension)
+{
+  sprintf_P(name, PSTR("XPL%05u.%s"), number, extension);
+}
+
+void OpenSegment()
+{
+  char name[13];
+
+  // continue the last segment
+  for (;;)
+  {
+    SegmentName(name, segment + 1, "LOG");
+    if (!SD.exists(name)) break;
+    segment++;
+  }
+
+  SegmentName(name, segment, "LOG");
+  logFile = SD.open(name, FILE_WRITE);
+  SegmentName(name, segment, "IDX");
+  indexFile = SD.open(name, FILE_WRITE);
+  recordsInBlock = 0;
+}
+
+// continue the time of the log after its last record
+void RestoreLogTime()
+{
+  struct_xpl_log_index entry;
+  uint32_t time;
+  byte record[RECORD_MAX];
+  uint16_t length;
+
+  // the last record is in the last indexed block, or after it
+  entry.offset = 0;
+  if (indexFile.size() >= XPL_LOG_INDEX_ENTRY)
+  {
+    indexFile.seek(indexFile.size() - XPL_LOG_INDEX_ENTRY);
+    ReadIndex(indexFile, &entry);
+  }
+
+  logFile.seek(entry.offset);
+  while (ReadRecord(logFile, &time, record, &length))
+  {
+    time_base = time + 1;
+  }
+
+  time_base -= millis();
+  indexFile.seek(indexFile.size());
+  logFile.seek(logFile.size());
+}
+
+void WriteIndex()
+{
+  byte data[XPL_LOG_INDEX_ENTRY];
+
+  logWriteIndex(data, &block);
+  indexFile.write(data, sizeof(data));
+  indexFile.flush();
+  logFile.flush();
+  recordsInBlock = 0;
+}
+
+void AfterParseAction(xPL_Message * message)
+{
+  byte header[XPL_LOG_RECORD_HEADER];
+  byte record[RECORD_MAX];
+  uint32_t time = LogTime();
+  uint16_t length = message->toBinary(record, RECORD_MAX);
+
+  if (length == 0 || !logFile)
+    return;
+
+  if (logFile.size() >= SEGMENT_SIZE)
+  {
+    if (recordsInBlock > 0) WriteIndex();
+    logFile.close();
+    indexFile.close();
+    segment++;
+    OpenSegment();
+  }
+
+  if (recordsInBlock == 0)
+  {
+    block.time = time;
+    block.offset = logFile.size();
+    block.sources = 0;
+    block.schemas = 0;
+  }
+
+  block.sources |= logHashBit(message->source.instance_id);
+  block.schemas |= logHashBit(message->schema.class_id);
+
+  logWriteRecordHeader(header, time, length);
+  logFile.write(header, sizeof(header));
+  logFile.write(record, length);
+
+  if (++recordsInBlock == INDEX_EVERY)
+  {
+    WriteIndex();
+  }
+}
+
+// print the logged messages received since '_from' (log time), of the source instance '_source'
+// and of the schema class '_class' (NULL = all)
+void PrintLog(unsigned long _from, const char *_source, const char *_class)
+{
+  char name[13];
+  xPL_LogQuery query(_from, _source, _class);
+
+  // the current block is not indexed yet
+  if (recordsInBlock > 0) WriteIndex();
+
+  for (word s = 0; s <= segment; s++)
+  {
+    SegmentName(name, s, "IDX");
+    File index = SD.open(name, FILE_READ);
+    SegmentName(name, s, "LOG");
+    File log = (s == segment) ? logFile : SD.open(name, FILE_READ);
+    struct_xpl_log_index entry, next;
+    bool more = ReadIndex(index, &entry);
+
+    while (more)
+    {
+      more = ReadIndex(index, &next);
+
+      // skip the blocks older than _from, or without the source/schema
+      if (!query.BlockMatch(&entry, more ? &next : NULL))
+      {
+        entry = next;
+        continue;
+      }
+
+      // a block ends where the next one starts (blocks may be partial, see WriteIndex)
+      unsigned long end = more ? next.offset : log.size();
+      log.seek(entry.offset);
+      while (log.position() < end)
+      {
+        byte record[RECORD_MAX];
+        uint32_t time;
+        uint16_t length;
+
+        if (!ReadRecord(log, &time, record, &length))
+          break;
+
+        xPL_Message message;
+        if (message.fromBinary(record, length) && query.RecordMatch(time, &message))
+        {
+          Serial.print(time);
+          Serial.print(F(" "));
+          char text[XPL_MESSAGE_BUFFER_MAX];
+          Serial.println(message.toString(text));
+        }
+      }
+
+      entry = next;
+    }
+
+    index.close();
+    if (s != segment) log.close();
+  }
+
+  // back to the end of the log for the next records
+  logFile.seek(logFile.size());
+}
+
+void ReadSerial()
+{
+  while (Serial.available())
+  {
+    char c = Serial.read();
+
+    if (c != '\n' && c != '\r')
+    {
+      if (serialLength < sizeof(serialBuff) - 1) serialBuff[serialLength++] = c;
+      continue;
+    }
+
+    serialBuff[serialLength] = '\0';
+    if (serialBuff[0] == 'p' || serialBuff[0] == 's')
+    {
+      unsigned long from = LogTime() > PRINT_PERIOD ? LogTime() - PRINT_PERIOD : 0;
+      char *filter = serialLength > 2 ? serialBuff + 2 : NULL;
+      PrintLog(from, serialBuff[0] == 'p' ? filter : NULL, serialBuff[0] == 's' ? filter : NULL);
+    }
+    serialLength = 0;
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Ethernet.begin(mac,ip);
+  Udp.begin(xpl.udp_port);  
+
+  if (SD.begin(SD_CS_PIN))
+  {
+    OpenSegment();
+    RestoreLogTime();
+  }
+  else
+  {
+    Serial.println(F("SD card failed"));
+  }
+  
+  xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback
+  xpl.AfterParseAction = &AfterParseAction;  // pointer to a post parsing action callback 
+  xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("logger")); // parameters for hearbeat message
+}
+
+void loop()
+{
+  xpl.Process();  // heartbeat management
+  
+  int packetSize = Udp.parsePacket();
+  if(packetSize)
+  {
+  	char xPLMessageBuff[XPL_MESSAGE_BUFFER_MAX];
+    
+    // read the packet into packetBufffer
+    Udp.read(xPLMessageBuff, XPL_MESSAGE_BUFFER_MAX);        
+    
+    // parse message
+    xpl.ParseInputMessage(xPLMessageBuff);
+  }
+
+  if (logFile && (millis()-flush_timer) >= FLUSH_INTERVAL)
+  {
+    logFile.flush();
+    flush_timer = millis();
+  }
+
+  ReadSerial();
+}
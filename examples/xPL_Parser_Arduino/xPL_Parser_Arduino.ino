@@ -58,7 +58,8 @@ void AfterParseAction(xPL_Message * message)
     }
     
     // show message     
-    Serial.println(message->toString());
+    char buffer[XPL_MESSAGE_BUFFER_MAX];
+    Serial.println(message->toString(buffer));
 }
 
 void setup()
@@ -70,6 +71,9 @@ void setup()
   xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback
   xpl.AfterParseAction = &AfterParseAction;  // pointer to a post parsing action callback 
   xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("test")); // parameters for hearbeat message
+#ifdef ENABLE_CONFIG
+  xpl.LoadConfig();  // instance id, interval, groups and filters saved by config.response
+#endif
 }
 
 void loop()
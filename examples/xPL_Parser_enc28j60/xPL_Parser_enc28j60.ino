@@ -45,6 +45,11 @@ void SendUdPMessage(char *buffer)
     ether.sendUdp (buffer, strlen(buffer), xpl.udp_port, broadcast, xpl.udp_port);
 }
 
+bool LinkUp()
+{
+    return ether.isLinkUp();
+}
+
 void AfterParseAction(xPL_Message * message)
 {
     if (xpl.TargetIsMe(message))
@@ -56,7 +61,8 @@ void AfterParseAction(xPL_Message * message)
     }
     
     // show message     
-    Serial.println(message->toString());
+    char buffer[XPL_MESSAGE_BUFFER_MAX];
+    Serial.println(message->toString(buffer));
 }
 
 void setup()
@@ -68,7 +74,11 @@ void setup()
 
   xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback
   xpl.AfterParseAction = &AfterParseAction;  // pointer to a post parsing action callback 
+  xpl.LinkUp = &LinkUp;  // first heartbeat as soon as the link is up
   xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("test")); // parameters for hearbeat message
+#ifdef ENABLE_CONFIG
+  xpl.LoadConfig();  // instance id, interval, groups and filters saved by config.response
+#endif
 }
 
 void loop()
@@ -30,9 +30,15 @@
 #include <EthernetUdp.h>
 
 #include "xPL.h"
+#include "xPL_Aggregator.h"
 
 xPL xpl;
 
+// temperature sensor, reported as sensor.basic device "1"
+const char temperature_device[] PROGMEM = "1";
+const char temperature_type[] PROGMEM = "temp";
+xPL_Aggregator temperature(&xpl, temperature_device, temperature_type);
+
 unsigned long timer = 0; 
 
 // Enter a MAC address and IP address for your controller below.
@@ -57,29 +63,25 @@ void setup()
   
   xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback 
   xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("test")); // parameters for hearbeat message
+
+  temperature.deadband = 0.5;
+  temperature.window = 300000UL;
 }
 
 void loop()
 {
-  xpl.Process();  // heartbeat management
+#ifdef ENABLE_PARSING
+  xpl.Process();  // heartbeat management (not built with XPL_NO_PARSING)
+#endif
    
-   // Example of sending an xPL Message every 10 second
-   if ((millis()-timer) >= 10000)
-   {
-     xPL_Message msg;
-
-     msg.hop = 1;
-     msg.type = XPL_TRIG;
-
-     msg.SetTarget_P(PSTR("*"));
-     msg.SetSchema_P(PSTR("sensor"), PSTR("basic"));
-
-     msg.AddCommand_P(PSTR("device"),PSTR("1"));
-     msg.AddCommand_P(PSTR("type"),PSTR("temp"));
-     msg.AddCommand_P(PSTR("current"),PSTR("22"));
+  // Example of reading a sensor every second (LM35 on A0)
+  // the aggregator sends a trig only when the temperature moves by more than 0.5 degree,
+  // and a stat with the lowest/highest/average values every 5 minutes
+  if ((millis()-timer) >= 1000)
+  {
+    temperature.Update(analogRead(A0) * 0.48828125);
+    timer = millis();
+  }
 
-     xpl.SendMessage(&msg);
-     
-     timer = millis();
-   } 
+  temperature.Process();  // periodic stat
 }
\ No newline at end of file
@@ -26,11 +26,17 @@
 */
 
 #include <xPL.h>
+#include <xPL_Aggregator.h>
 #include <EtherCard.h>
 
 byte Ethernet::buffer[XPL_MESSAGE_BUFFER_MAX];
 xPL xpl;
 
+// temperature sensor, reported as sensor.basic device "1"
+const char temperature_device[] PROGMEM = "1";
+const char temperature_type[] PROGMEM = "temp";
+xPL_Aggregator temperature(&xpl, temperature_device, temperature_type);
+
 // Init du serveur HTTP
 uint8_t mymac[6] = { 0x54,0x55,0x58,0x10,0x00,0x11 };
 uint8_t myip[4] = { 192,168,0,133 };
@@ -56,28 +62,22 @@ void setup()
  
   xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback
   xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("test")); // parameters for hearbeat message
+
+  temperature.deadband = 0.5;
+  temperature.window = 300000UL;
 }
 
 void loop()
 {
 
-   // Example of sending an xPL Message every 10 second
-   if ((millis()-timer) >= 10000)
+   // Example of reading a sensor every second (LM35 on A0)
+   // the aggregator sends a trig only when the temperature moves by more than 0.5 degree,
+   // and a stat with the lowest/highest/average values every 5 minutes
+   if ((millis()-timer) >= 1000)
    {
-     xPL_Message msg;
-
-     msg.hop = 1;
-     msg.type = XPL_TRIG;
-
-     msg.SetTarget_P(PSTR("*"));
-     msg.SetSchema_P(PSTR("sensor"), PSTR("basic"));
-
-     msg.AddCommand_P(PSTR("device"),PSTR("1"));
-     msg.AddCommand_P(PSTR("type"),PSTR("temp"));
-     msg.AddCommand_P(PSTR("current"),PSTR("22"));
-    
-     xpl.SendMessage(&msg);
-     
+     temperature.Update(analogRead(A0) * 0.48828125);
      timer = millis();
-   } 
+   }
+
+   temperature.Process();  // periodic stat
 }
\ No newline at end of file
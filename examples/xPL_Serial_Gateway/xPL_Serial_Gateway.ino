@@ -0,0 +1,142 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include <SPI.h>        
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+#include "xPL.h"
+#include "xPL_Serial.h"
+
+// Gateway between the xPL network (UDP, text messages) and an RS-485 bus of
+// xPL nodes (binary frames, see xPL_Serial.h), for an Arduino Mega:
+// - the messages received on UDP are sent on the bus
+// - the messages received from the bus are sent on UDP, with their own source
+// - both are handled by the gateway too (heartbeat and config requests, groups),
+//   only the messages accepted by its filters are forwarded, and its sensor cache
+//   answers the sensor.request for the bus nodes that sleep
+// - the hop count is increased at each crossing
+// See the xPL_Serial_Node example for a node on the bus.
+// What does not fit in the library limits is lost on the way:
+// - hop counts above 31 are sent on the bus as 31
+// - UDP -> bus: names longer than XPL_NAME_LENGTH_MAX and values longer than
+//   XPL_VALUE_LENGTH_MAX characters are cut, the commands after XPL_MESSAGE_COMMAND_MAX
+//   are dropped
+// - bus -> UDP: a frame with longer names/values or more commands is rejected
+//   (bus.errors), the commands that do not fit in XPL_MESSAGE_BUFFER_MAX are dropped
+// The UDP messages are sent asynchronously, chunk by chunk from xpl.Process(), so the
+// bus is still read while a burst of messages goes out.
+// The ingoing UDP messages wait in the input queue: every packet available is read
+// before xpl.Process(), which parses the commands first during a burst.
+
+#define BUS_BAUD_RATE   19200
+#define BUS_DE_PIN      2       // RS-485 transceiver DE/RE pin
+#define INPUT_QUEUE     4       // UDP messages waiting for xpl.Process()
+#define SENSOR_CACHE    8       // last values of the bus sensors
+
+xPL xpl;
+xPL_Serial bus(&Serial1, BUS_DE_PIN);
+
+// Enter a MAC address and IP address for your controller below.
+// The IP address will be dependent on your local network:
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+IPAddress ip(10, 0, 0, 177);
+IPAddress broadcast(10, 0, 0, 255);
+EthernetUDP Udp;
+
+void SendUdPMessage(char *buffer)
+{
+    Udp.beginPacket(broadcast, xpl.udp_port);
+    Udp.write(buffer);
+    Udp.endPacket(); 
+}
+
+void SendUdPChunk(char *chunk, byte length, bool first, bool last)
+{
+    if (first) Udp.beginPacket(broadcast, xpl.udp_port);
+    Udp.write((uint8_t *)chunk, length);
+    if (last) Udp.endPacket();
+}
+
+bool fromBus = false;  // origin of the message given to AfterParseAction
+
+// UDP -> bus, bus -> UDP
+void AfterParseAction(xPL_Message * message)
+{
+  message->hop++;
+
+  if (fromBus)
+    xpl.SendMessage(message, false);
+  else
+    bus.SendMessage(message);
+}
+
+void BusReceiveAction(xPL_Message * message)
+{
+  fromBus = true;
+  xpl.ProcessMessage(message);
+  fromBus = false;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial1.begin(BUS_BAUD_RATE);
+  Ethernet.begin(mac,ip);
+  Udp.begin(xpl.udp_port);  
+  
+  xpl.SendExternal = &SendUdPMessage;  // pointer to the send callback
+  xpl.SendChunk = &SendUdPChunk;  // pointer to the asynchronous send callback
+  xpl.SetAsyncSend(true);
+  xpl.AfterParseAction = &AfterParseAction;  // pointer to a post parsing action callback 
+  xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("gateway")); // parameters for hearbeat message
+  xpl.SetInputQueue(INPUT_QUEUE);
+  xpl.SetSensorCache(SENSOR_CACHE);
+
+  bus.begin();
+  bus.ReceiveAction = &BusReceiveAction;
+}
+
+void loop()
+{
+  // queue every packet received since the last loop, the queue drops the least
+  // important ones when it is full
+  while (Udp.parsePacket() > 0)
+  {
+  	char xPLMessageBuff[XPL_MESSAGE_BUFFER_MAX];
+    
+    // read the packet into packetBufffer
+    int length = Udp.read(xPLMessageBuff, XPL_MESSAGE_BUFFER_MAX - 1);
+    if (length <= 0) continue;
+    xPLMessageBuff[length] = '\0';
+    
+    xpl.QueueInputMessage(xPLMessageBuff);
+  }
+
+  xpl.Process();  // heartbeat management, queued messages by priority
+  bus.Process();  // frames received from the bus
+}
@@ -0,0 +1,92 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include "xPL.h"
+#include "xPL_Serial.h"
+
+// Node on the RS-485 bus of the xPL_Serial_Gateway example, without Ethernet:
+// - the frames of the bus are handled by xpl.ProcessMessage like the UDP messages of
+//   the other examples (heartbeat and config requests, groups, filters)
+// - the messages of xpl (heartbeats, answers) are sent on the bus
+// - a lighting.basic command sent to the node switches the LED
+
+#define BUS_BAUD_RATE   19200
+#define BUS_DE_PIN      2       // RS-485 transceiver DE/RE pin
+#define LED_PIN         13
+
+xPL xpl;
+xPL_Serial bus(&Serial, BUS_DE_PIN);
+
+// xpl -> bus, the messages of xpl are text
+void SendBusMessage(char *buffer)
+{
+  xPL_Message message;
+
+  xpl.Parse(&message, buffer);
+  bus.SendMessage(&message);
+}
+
+// bus -> xpl
+void BusReceiveAction(xPL_Message * message)
+{
+  xpl.ProcessMessage(message);
+}
+
+void AfterParseAction(xPL_Message * message)
+{
+  if (message->type == XPL_CMND && xpl.TargetIsMe(message) && message->IsSchema_P(PSTR("lighting"), PSTR("basic")))
+  {
+    char *level = message->GetCommandValue_P(PSTR("level"));
+
+    if (level != NULL)
+    {
+      digitalWrite(LED_PIN, atoi(level) > 0 ? HIGH : LOW);
+    }
+  }
+}
+
+void setup()
+{
+  Serial.begin(BUS_BAUD_RATE);
+  pinMode(LED_PIN, OUTPUT);
+
+  bus.begin();
+  bus.ReceiveAction = &BusReceiveAction;
+
+  xpl.SendExternal = &SendBusMessage;  // pointer to the send callback
+  xpl.AfterParseAction = &AfterParseAction;  // pointer to a post parsing action callback 
+  xpl.SetSource_P(PSTR("xpl"), PSTR("arduino"), PSTR("node")); // parameters for hearbeat message
+#ifdef ENABLE_CONFIG
+  xpl.LoadConfig();  // instance id, interval, groups and filters saved by config.response
+#endif
+}
+
+void loop()
+{
+  xpl.Process();  // heartbeat management
+  bus.Process();  // frames received from the bus
+}
@@ -0,0 +1,368 @@
+#!/usr/bin/env python3
+#
+# xPL.Arduino footprint benchmark
+#
+# Compiles the library and its examples for several boards and configurations
+# with arduino-cli, and a probe sketch with the host compiler, and reports:
+# - flash and static RAM of each sketch (arduino-cli size report, size on the host)
+# - worst-case stack of the public entry points (xPL::Parse, xPL_Message::toString,
+#   xPL::SendHBeat...), from -fstack-usage and the call graph of the ELF (objdump);
+#   ">=N" is a lower bound: a callee has no -fstack-usage data (vfprintf and vfscanf of
+#   avr-libc, the libc of the host...) and its frame is not counted
+# - peak heap of ParseInputMessage, from sizeof(xPL_Message) and sizeof(struct_command)
+#
+# arduino:avr builds with -flto, and -fstack-usage writes nothing for LTO objects:
+# the stack is measured on a build of the probe without LTO, where the functions
+# of different files are not inlined into each other.
+#
+# The results are compared with footprint_baseline.txt, so size gains and losses
+# are visible from one release to the next.
+#
+# Usage:
+#   extras/footprint.py              report and compare with the baseline
+#   extras/footprint.py --update     report and write the baseline (the rows of the
+#                                    boards that were not built are kept)
+#   extras/footprint.py --check      exit with an error if something grew, or does
+#                                    not build anymore
+#
+# Needs arduino-cli with the arduino:avr core, the Ethernet and SD libraries, and
+# EtherCard for the enc28j60 examples (a sketch that does not build is reported as "-").
+# The sendonly configuration only builds the xPL_Send_* examples, the others parse.
+# Without arduino-cli, only the host is measured. The host build only has the probe
+# sketch (extras/host has the part of the Arduino core used by the library), its
+# figures are for x86-64 and only follow the trend.
+#
+# Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BASELINE = os.path.join(ROOT, 'extras', 'footprint_baseline.txt')
+HOST = os.path.join(ROOT, 'extras', 'host')
+
+# board: (fqbn, bytes pushed by a call, malloc header), fqbn None = host compiler
+BOARDS = {
+    'uno': ('arduino:avr:uno', 2, 2),
+    'mega': ('arduino:avr:mega', 3, 2),
+    # x86-64: the return address is counted in the -fstack-usage frames
+    'host': (None, 0, 8),
+}
+
+# config: (flags, examples built), the smallest XPL_VALUE_LENGTH_MAX is XPL_INSTANCE_ID_MAX + 10
+CONFIGS = {
+    'default': ([], 'xPL_*'),
+    'small': (['-DXPL_VALUE_LENGTH_MAX=26', '-DXPL_MESSAGE_COMMAND_MAX=5'], 'xPL_*'),
+    'noconfig': (['-DXPL_NO_CONFIG'], 'xPL_*'),
+    'sendonly': (['-DXPL_NO_PARSING'], 'xPL_Send_*'),
+}
+
+ENTRY_POINTS = [
+    'xPL::Parse',
+    'xPL::ParseInputMessage',
+    'xPL_Message::toString',
+    'xPL::SendHBeat',
+]
+
+# sketch reaching every entry point, also used to get the size of the structures
+PROBE_SKETCH = r'''
+#include <xPL.h>
+
+xPL xpl;
+
+volatile char xpl_sizeof_message[sizeof(xPL_Message)];
+volatile char xpl_sizeof_command[sizeof(struct_command)];
+
+void Send(char *buffer) { xpl_sizeof_message[0] = buffer[0]; xpl_sizeof_command[0] = buffer[1]; }
+
+void setup()
+{
+  char buffer[] = "xpl-cmnd\n{\nhop=1\nsource=a-b.c\ntarget=*\n}\nhbeat.request\n{\ncommand=request\n}\n";
+  xPL_Message msg;
+
+  xpl.SendExternal = &Send;
+  xpl.SendMessage(&msg);
+#ifdef ENABLE_PARSING
+  xpl.ParseInputMessage(buffer);
+  xpl.Process();
+#endif
+}
+
+void loop()
+{
+}
+'''
+
+
+def run(cmd):
+    return subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+
+
+def compile_sketch(sketch, fqbn, flags, build_path):
+    extra = ' '.join(flags)
+    result = run(['arduino-cli', 'compile', '--fqbn', fqbn,
+                  '--library', ROOT,
+                  '--build-path', build_path,
+                  '--build-property', 'compiler.cpp.extra_flags=' + extra,
+                  '--build-property', 'compiler.c.extra_flags=' + extra,
+                  sketch])
+    if result.returncode != 0:
+        return None
+
+    flash = re.search(r'Sketch uses (\d+) bytes', result.stdout)
+    ram = re.search(r'Global variables use (\d+) bytes', result.stdout)
+    if not flash or not ram:
+        return None
+    return int(flash.group(1)), int(ram.group(1))
+
+
+def compile_host(sketch, flags, build_path):
+    os.makedirs(build_path)
+    ino = glob.glob(os.path.join(sketch, '*.ino'))[0]
+    elf = os.path.join(build_path, 'probe.elf')
+    sources = sorted(glob.glob(os.path.join(ROOT, '*.cpp'))) + [os.path.join(HOST, 'main.cpp')]
+    # the .su files are written in the current directory, extras/host stands for
+    # avr-libc (__AVR__ builds the config.* support)
+    result = subprocess.run(['g++', '-std=gnu++11', '-Os', '-fstack-usage',
+                             '-ffunction-sections', '-fdata-sections', '-Wl,--gc-sections',
+                             '-D__AVR__', '-I', HOST, '-I', ROOT] + flags +
+                            ['-x', 'c++', ino, '-x', 'none'] + sources + ['-o', elf],
+                            cwd=build_path, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    if result.returncode != 0:
+        return None
+
+    # text + data, data + bss
+    fields = run(['size', elf]).stdout.splitlines()[1].split()
+    text, data, bss = int(fields[0]), int(fields[1]), int(fields[2])
+    return text + data, data + bss
+
+
+def function_key(name):
+    # "char* xPL_Message::toString(char*)" and "xPL_Message::toString(char*)"
+    # -> "xPL_Message::toString/1" (name and number of arguments)
+    match = re.search(r'([\w:~]+)\((.*)\)', name)
+    if not match:
+        return name.strip()
+    args = match.group(2).strip()
+    count = 0 if args in ('', 'void') else args.count(',') + 1
+    return '%s/%d' % (match.group(1), count)
+
+
+def stack_usage(build_path):
+    usage = {}
+    for su in glob.glob(os.path.join(build_path, '**', '*.su'), recursive=True):
+        with open(su) as f:
+            for line in f:
+                fields = line.rstrip('\n').split('\t')
+                if len(fields) < 2:
+                    continue
+                name = fields[0].split(':', 3)[-1]
+                usage[function_key(name)] = int(fields[1])
+    return usage
+
+
+def call_graph(elf, objdump):
+    graph = {}
+    current = None
+    result = run([objdump, '-d', '-C', elf])
+    for line in result.stdout.splitlines():
+        label = re.match(r'^[0-9a-f]+ <(.+)>:$', line)
+        if label:
+            current = function_key(label.group(1))
+            graph.setdefault(current, set())
+            continue
+        if current and re.search(r'\b(r?call|r?jmp)\b', line):
+            target = re.search(r'<([^>+]+)(\+0x[0-9a-f]+)?>', line)
+            if target and function_key(target.group(1)) != current:
+                graph[current].add(function_key(target.group(1)))
+    return graph
+
+
+def worst_stack(function, graph, usage, call_size, memo, seen=()):
+    # (own frame + return address + deepest callee, exact)
+    # function pointers (icall) are not followed, recursion is counted once
+    # a function without -fstack-usage data (libc, libgcc, PLT) is counted as 0 bytes,
+    # and the result is only a lower bound
+    if function in seen:
+        return 0, True
+    if function not in memo:
+        deepest, exact = 0, function in usage
+        for callee in graph.get(function, ()):
+            stack, callee_exact = worst_stack(callee, graph, usage, call_size, memo, seen + (function,))
+            deepest = max(deepest, stack)
+            exact = exact and callee_exact
+        memo[function] = (usage.get(function, 0) + call_size + deepest, exact)
+    return memo[function]
+
+
+def symbol_sizes(elf, nm):
+    sizes = {}
+    result = run([nm, '-S', elf])
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            sizes[fields[3]] = int(fields[1], 16)
+    return sizes
+
+
+def find_tools():
+    # avr-objdump/avr-nm of the arduino:avr core, if not in the PATH
+    if shutil.which('avr-objdump'):
+        return
+    data = run(['arduino-cli', 'config', 'get', 'directories.data']).stdout.strip()
+    for tool in sorted(glob.glob(os.path.join(data, 'packages', 'arduino', 'tools', 'avr-gcc', '*', 'bin'))):
+        os.environ['PATH'] = tool + os.pathsep + os.environ['PATH']
+
+
+def measure(boards):
+    results = {}
+    work = tempfile.mkdtemp(prefix='xpl-footprint-')
+
+    probe = os.path.join(work, 'xPL_Footprint_Probe')
+    os.mkdir(probe)
+    with open(os.path.join(probe, 'xPL_Footprint_Probe.ino'), 'w') as f:
+        f.write(PROBE_SKETCH)
+
+    try:
+        for board in sorted(boards):
+            fqbn, call_size, malloc_header = BOARDS[board]
+            objdump, nm = ('avr-objdump', 'avr-nm') if fqbn else ('objdump', 'nm')
+
+            for config, (flags, pattern) in sorted(CONFIGS.items()):
+                sketches = sorted(glob.glob(os.path.join(ROOT, 'examples', pattern))) if fqbn else []
+                for sketch in [probe] + sketches:
+                    name = os.path.basename(sketch)
+                    build_path = os.path.join(work, board, config, name)
+                    if fqbn:
+                        size = compile_sketch(sketch, fqbn, flags, build_path)
+                    else:
+                        size = compile_host(sketch, flags, build_path)
+                    key = '%s %s %s' % (board, config, name)
+                    results[key + ' flash'] = size[0] if size else None
+                    results[key + ' ram'] = size[1] if size else None
+
+                    if sketch != probe or size is None:
+                        continue
+
+                    if fqbn:
+                        build_path += '-stack'
+                        if compile_sketch(sketch, fqbn, flags + ['-fno-lto', '-fstack-usage'], build_path) is None:
+                            continue
+
+                    elf = glob.glob(os.path.join(build_path, '*.elf'))[0]
+                    usage = stack_usage(build_path)
+                    graph = call_graph(elf, objdump)
+                    memo = {}
+                    for entry in ENTRY_POINTS:
+                        stacks = [worst_stack(k, graph, usage, call_size, memo)
+                                  for k in graph if k.split('/')[0] == entry]
+                        stack = None
+                        if stacks:
+                            # ">=N" when a callee was not measured
+                            stack = max(size for size, exact in stacks)
+                            if not all(exact for size, exact in stacks):
+                                stack = '>=%d' % stack
+                        results['%s %s stack %s' % (board, config, entry)] = stack
+
+                    sizes = symbol_sizes(elf, nm)
+                    message = sizes.get('xpl_sizeof_message')
+                    command = sizes.get('xpl_sizeof_command')
+                    commands = default_command_max()
+                    for flag in flags:
+                        if flag.startswith('-DXPL_MESSAGE_COMMAND_MAX='):
+                            commands = int(flag.split('=')[1])
+                    heap = None
+                    if message and command and '-DXPL_NO_PARSING' not in flags:
+                        # message + commands, realloc may hold the old and new arrays,
+                        # with a malloc header per block
+                        count = commands + 1
+                        heap = message + malloc_header + (2 * count - 1) * command + 2 * malloc_header
+                    results['%s %s heap xPL::ParseInputMessage' % (board, config)] = heap
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    return results
+
+
+def default_command_max():
+    with open(os.path.join(ROOT, 'xPL_Message.h')) as f:
+        return int(re.search(r'#define XPL_MESSAGE_COMMAND_MAX\s+(\d+)', f.read()).group(1))
+
+
+def number(value):
+    # 123 or ">=123" (lower bound) -> 123
+    return int(str(value).lstrip('>='))
+
+
+def load_baseline():
+    baseline = {}
+    if os.path.exists(BASELINE):
+        with open(BASELINE) as f:
+            for line in f:
+                if line.strip() and not line.startswith('#'):
+                    key, value = line.rstrip('\n').rsplit(' ', 1)
+                    baseline[key] = None if value == '-' else (value if value.startswith('>=') else int(value))
+    return baseline
+
+
+def main():
+    parser = argparse.ArgumentParser(description='xPL.Arduino footprint benchmark')
+    parser.add_argument('--update', action='store_true', help='write the baseline')
+    parser.add_argument('--check', action='store_true', help='fail if something grew or does not build anymore')
+    args = parser.parse_args()
+
+    boards = []
+    for board, (fqbn, call_size, malloc_header) in sorted(BOARDS.items()):
+        if fqbn is None and shutil.which('g++'):
+            boards.append(board)
+        elif fqbn is not None and shutil.which('arduino-cli'):
+            boards.append(board)
+        else:
+            print('%s: not measured, %s not found' % (board, 'arduino-cli' if fqbn else 'g++'), file=sys.stderr)
+    if not boards:
+        sys.exit('nothing to measure')
+    if 'uno' in boards or 'mega' in boards:
+        find_tools()
+
+    results = measure(boards)
+    baseline = load_baseline()
+    failed = False
+
+    for key in sorted(results):
+        value = results[key]
+        old = baseline.get(key)
+        text = '-' if value is None else str(value)
+        if value is None and old is not None:
+            # built before, not anymore
+            text += ' (was %s)' % old
+            failed = True
+        elif value is not None and old is not None and number(value) != number(old):
+            text += ' (%+d)' % (number(value) - number(old))
+            failed = failed or number(value) > number(old)
+        print('%-70s %s' % (key, text))
+
+    if args.update:
+        baseline.update(results)
+        with open(BASELINE, 'w') as f:
+            f.write('# generated by extras/footprint.py --update\n')
+            for key in sorted(baseline):
+                f.write('%s %s\n' % (key, '-' if baseline[key] is None else baseline[key]))
+
+    if args.check and failed:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
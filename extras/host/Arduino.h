@@ -0,0 +1,87 @@
+/*
+ * xPL.Arduino footprint benchmark, host build
+ *
+ * The part of the Arduino core used by the library, to build the footprint
+ * probe with the host compiler (see extras/footprint.py). Not a port: the
+ * program memory is plain memory and there is no hardware.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef bool boolean;
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_ptr(p) (*(const void* const*)(p))
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strstr_P strstr
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define sscanf_P sscanf
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+unsigned long millis();
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+char *dtostrf(double, signed char, unsigned char, char *);
+
+class Print
+{
+  public:
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+      for (size_t i = 0; i < size; i++) write(buffer[i]);
+      return size;
+    }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual void flush() {}
+};
+
+class IPAddress
+{
+  public:
+    IPAddress() { memset(address, 0, sizeof(address)); }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { address[0] = a; address[1] = b; address[2] = c; address[3] = d; }
+    uint8_t operator[](int index) const { return address[index]; }
+    uint8_t& operator[](int index) { return address[index]; }
+
+  private:
+    uint8_t address[4];
+};
+
+void setup();
+void loop();
+
+#endif
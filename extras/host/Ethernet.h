@@ -0,0 +1,5 @@
+/*
+ * xPL.Arduino footprint benchmark, host build: IPAddress is in Arduino.h
+ */
+
+#include "Arduino.h"
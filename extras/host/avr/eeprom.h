@@ -0,0 +1,8 @@
+/*
+ * xPL.Arduino footprint benchmark, host build: an erased EEPROM
+ */
+
+#include <stddef.h>
+
+void eeprom_read_block(void *, const void *, size_t);
+void eeprom_update_block(const void *, void *, size_t);
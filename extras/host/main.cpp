@@ -0,0 +1,42 @@
+/*
+ * xPL.Arduino footprint benchmark, host build: runs the probe sketch once
+ */
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include <time.h>
+
+unsigned long millis()
+{
+  return (unsigned long)(clock() / (CLOCKS_PER_SEC / 1000));
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+char *dtostrf(double value, signed char width, unsigned char precision, char *buffer)
+{
+  sprintf(buffer, "%*.*f", width, precision, value);
+  return buffer;
+}
+
+void eeprom_read_block(void *destination, const void *, size_t size)
+{
+  memset(destination, 0xFF, size);
+}
+
+void eeprom_update_block(const void *, void *, size_t)
+{
+}
+
+int main()
+{
+  setup();
+  loop();
+  return 0;
+}
@@ -28,6 +28,10 @@
 #include <Ethernet.h> // for IPaddress
 #include "xPL.h"
 
+#ifdef ENABLE_CONFIG
+#include <avr/eeprom.h>
+#endif
+
 #define XPL_LINE_MESSAGE_BUFFER_MAX			128	// max length of a line			// maximum command in a xpl message
 #define XPL_END_OF_LINE						10
 
@@ -51,6 +55,8 @@
 #define XPL_HBEAT_ANSWER_CLASS_ID  "hbeat"
 #define XPL_HBEAT_ANSWER_TYPE_ID  "app"
 
+#define XPL_GROUP_PREFIX  "xpl-group."
+
 /* xPL Class */
 xPL::xPL()
 {
@@ -61,15 +67,47 @@ xPL::xPL()
 
 #ifdef ENABLE_PARSING
   AfterParseAction = NULL;
+  LinkUp = NULL;
 
   last_heartbeat = 0;
   hbeat_interval = XPL_DEFAULT_HEARTBEAT_INTERVAL;
   xpl_accepted = XPL_ACCEPT_ALL;
+
+  drop_policy = XPL_DROP_LOWEST_OLDEST;
+  memset(dropped, 0, sizeof(dropped));
+  input_queue = NULL;
+  input_queue_size = 0;
+  input_order = 0;
+  sensor_cache = NULL;
+  sensor_cache_size = 0;
+
+  SendChunk = NULL;
+  AfterSendAction = NULL;
+  send_buffer = NULL;
+#endif
+
+#ifdef ENABLE_CONFIG
+  memset(group, 0, sizeof(group));
+  memset(filter, 0, sizeof(filter));
 #endif
 }
 
 xPL::~xPL()
 {
+#ifdef ENABLE_PARSING
+	if(input_queue != NULL)
+	{
+		free(input_queue);
+	}
+	if(sensor_cache != NULL)
+	{
+		free(sensor_cache);
+	}
+	if(send_buffer != NULL)
+	{
+		free(send_buffer);
+	}
+#endif
 }
 
 /// Set the source of outgoing xPL messages
@@ -87,6 +125,14 @@ void xPL::SetSource_P(const PROGMEM char * _vendorId, const PROGMEM char * _devi
  */
 void xPL::SendMessage(char *_buffer)
 {
+#ifdef ENABLE_PARSING
+	if (send_buffer != NULL)
+	{
+		strncpy(FreeSendBuffer(), _buffer, XPL_MESSAGE_BUFFER_MAX - 1);
+		return;
+	}
+#endif
+
 	(*SendExternal)(_buffer);
 }
 
@@ -103,7 +149,16 @@ void xPL::SendMessage(xPL_Message *_message, bool _useDefaultSource)
 		_message->SetSource(source.vendor_id, source.device_id, source.instance_id);
 	}
 
-    SendMessage(_message->toString());
+#ifdef ENABLE_PARSING
+	if (send_buffer != NULL)
+	{
+		_message->toString(FreeSendBuffer());
+		return;
+	}
+#endif
+
+	char buffer[XPL_MESSAGE_BUFFER_MAX];
+	SendMessage(_message->toString(buffer));
 }
 
 #ifdef ENABLE_PARSING
@@ -116,13 +171,236 @@ void xPL::Process()
 {
 	static bool bFirstRun = true;
 
-	// Check heartbeat + send
-	if ((millis()-last_heartbeat >= (unsigned long)hbeat_interval * 1000)
-		  || (bFirstRun && millis() > 3000))
+	// Check heartbeat + send, the first one as soon as the link is up
+	if ((!bFirstRun && millis()-last_heartbeat >= (unsigned long)hbeat_interval * 1000)
+		  || (bFirstRun && (LinkUp != NULL ? (*LinkUp)() : millis() > XPL_LINK_UP_DELAY)))
 	{
 		SendHBeat();
 		bFirstRun = false;
 	}
+
+	// Go on with the message being sent
+	if (send_buffer != NULL)
+	{
+		SendNextChunk();
+	}
+
+	// Parse the queued messages, highest priority first, then oldest first
+	for (;;)
+	{
+		struct_xpl_queued *next = NULL;
+
+		for (byte i = 0; i < input_queue_size; i++)
+		{
+			struct_xpl_queued *queued = &input_queue[i];
+
+			if (queued->used
+				&& (next == NULL
+					|| queued->priority > next->priority
+					|| (queued->priority == next->priority && (int)(queued->order - next->order) < 0)))
+			{
+				next = queued;
+			}
+		}
+
+		if (next == NULL) break;
+
+		ParseInputMessage(next->buffer);
+		next->used = false;
+	}
+}
+
+/**
+ * \brief       Enable the asynchronous send
+ * \details   SendMessage copies the message in one of two buffers and returns, Process()
+ *            sends it: by chunks of XPL_SEND_CHUNK_SIZE bytes given to SendChunk if set
+ *            (one chunk per Process), else with SendExternal. The ingoing messages can be
+ *            handled while a message is sent. Takes 2 x XPL_MESSAGE_BUFFER_MAX bytes of RAM.
+ * \param    _enable         true for asynchronous, false to send in SendMessage
+ * \return   false if out of memory (synchronous send)
+ */
+bool xPL::SetAsyncSend(bool _enable)
+{
+	if (send_buffer != NULL)
+	{
+		FlushSend();
+		free(send_buffer);
+		send_buffer = NULL;
+	}
+
+	if (!_enable)
+		return true;
+
+	send_buffer = (char*)malloc(2 * XPL_MESSAGE_BUFFER_MAX);
+	if (send_buffer == NULL)
+		return false;
+
+	send_pending[0] = false;
+	send_pending[1] = false;
+	send_active = 0;
+	send_position = 0;
+	return true;
+}
+
+/**
+ * \brief       Send the pending messages now
+ */
+void xPL::FlushSend()
+{
+	while (send_pending[0] || send_pending[1])
+	{
+		SendNextChunk();
+	}
+}
+
+/**
+ * \brief       Get a buffer for the next message to send
+ * \details   The messages are sent in order: 'send_active' is the oldest pending buffer
+ *            (or the next one to use when none is pending), the new message goes behind it.
+ *            When both buffers are used, the message being sent is finished first.
+ */
+char* xPL::FreeSendBuffer()
+{
+	if (send_pending[0] && send_pending[1])
+	{
+		byte head = send_active;
+		while (send_pending[head])
+		{
+			SendNextChunk();
+		}
+	}
+
+	byte next = send_pending[send_active] ? 1 - send_active : send_active;
+	char *buffer = send_buffer + next * XPL_MESSAGE_BUFFER_MAX;
+
+	buffer[XPL_MESSAGE_BUFFER_MAX - 1] = '\0';
+	send_pending[next] = true;
+	return buffer;
+}
+
+/**
+ * \brief       Send the next part of the pending message
+ */
+void xPL::SendNextChunk()
+{
+	if (!send_pending[send_active])
+		return;
+
+	char *buffer = send_buffer + send_active * XPL_MESSAGE_BUFFER_MAX;
+	unsigned int length = strlen(buffer);
+
+	if (SendChunk != NULL)
+	{
+		byte chunk = min(length - send_position, XPL_SEND_CHUNK_SIZE);
+		bool first = (send_position == 0);
+
+		send_position += chunk;
+		(*SendChunk)(buffer + send_position - chunk, chunk, first, send_position >= length);
+
+		if (send_position < length)
+			return;
+	}
+	else
+	{
+		(*SendExternal)(buffer);
+	}
+
+	send_position = 0;
+	send_pending[send_active] = false;
+	send_active = 1 - send_active;  // the next message, if any
+
+	if (AfterSendAction != NULL)
+	{
+		(*AfterSendAction)(buffer);
+	}
+}
+
+/**
+ * \brief       Set the size of the input queue
+ * \details   Messages given to QueueInputMessage wait in the queue and are parsed by Process(),
+ *            by priority. Each entry takes XPL_MESSAGE_BUFFER_MAX bytes of RAM.
+ *            The priorities only apply if the sketch queues every packet available before
+ *            calling Process() (see the xPL_Serial_Gateway example), Process() parses the
+ *            whole queue.
+ * \param    _size         number of messages, 0 = no queue (messages parsed immediately)
+ * \return   false if out of memory (no queue)
+ */
+bool xPL::SetInputQueue(byte _size)
+{
+	if(input_queue != NULL)
+	{
+		free(input_queue);
+		input_queue = NULL;
+	}
+	input_queue_size = 0;
+
+	if (_size == 0)
+		return true;
+
+	input_queue = (struct_xpl_queued*)calloc(_size, sizeof(struct_xpl_queued));
+	if (input_queue == NULL)
+		return false;
+
+	input_queue_size = _size;
+	return true;
+}
+
+/**
+ * \brief       Queue an ingoing xPL message
+ * \details   The message is copied in the input queue, Process() parses it. When the queue
+ *            is full, a message is dropped according to 'drop_policy' and counted in 'dropped'.
+ * \param    buffer         buffer of the ingoing UDP Packet
+ */
+void xPL::QueueInputMessage(char* _buffer)
+{
+	if (input_queue_size == 0)
+	{
+		ParseInputMessage(_buffer);
+		return;
+	}
+
+	byte priority = InputPriority(_buffer);
+	struct_xpl_queued *slot = NULL;
+	struct_xpl_queued *victim = NULL;
+
+	for (byte i = 0; i < input_queue_size; i++)
+	{
+		struct_xpl_queued *queued = &input_queue[i];
+
+		if (!queued->used)
+		{
+			slot = queued;
+			break;
+		}
+
+		// oldest message of the lowest priority
+		if (victim == NULL
+			|| queued->priority < victim->priority
+			|| (queued->priority == victim->priority && (int)(queued->order - victim->order) < 0))
+		{
+			victim = queued;
+		}
+	}
+
+	if (slot == NULL)
+	{
+		// a cmnd is only replaced by a more important one
+		if (drop_policy == XPL_DROP_NEWEST || victim->priority > priority
+			|| (victim->priority == priority && priority >= XPL_PRIORITY_CMND))
+		{
+			dropped[priority]++;
+			return;
+		}
+
+		dropped[victim->priority]++;
+		slot = victim;
+	}
+
+	strncpy(slot->buffer, _buffer, XPL_MESSAGE_BUFFER_MAX - 1);
+	slot->buffer[XPL_MESSAGE_BUFFER_MAX - 1] = '\0';
+	slot->priority = priority;
+	slot->order = input_order++;
+	slot->used = true;
 }
 
 /**
@@ -134,28 +412,78 @@ void xPL::ParseInputMessage(char* _buffer)
 {
 	xPL_Message* xPLMessage = new xPL_Message();
 	Parse(xPLMessage, _buffer);
+	ProcessMessage(xPLMessage, _buffer);
+	delete xPLMessage;
+}
+
+/**
+ * \brief       Handle an ingoing xPL message
+ * \details   Resolve the group target, answer the heartbeat, sensor and config requests, and call
+ *            the user defined callback. For the messages received by another transport than UDP
+ *            (e.g. xPL_Serial::ReceiveAction), ParseInputMessage calls it for UDP.
+ * \param    message         an xPL message
+ * \param    buffer          the message as text (optional), the filters of a config.response
+ *                           are read in it, without being cut at XPL_VALUE_LENGTH_MAX characters
+ */
+void xPL::ProcessMessage(xPL_Message* _message, char* _buffer)
+{
+#ifdef ENABLE_CONFIG
+	// xpl-group.<name> of one of our groups
+	_message->target_group = 0;
+	if (strcmp_P(_message->target.vendor_id, PSTR("xpl")) == 0
+		&& strcmp_P(_message->target.device_id, PSTR("group")) == 0)
+	{
+		_message->target_group = GroupMask(_message->target.instance_id);
+	}
+#endif
 
 	// check if the message is an hbeat.request to send a heartbeat
-	if (CheckHBeatRequest(xPLMessage))
+	if (CheckHBeatRequest(_message))
 	{
 		SendHBeat();
 	}
 
+	// keep the last sensor values, answer the sensor.request of the sleeping nodes
+	UpdateSensorCache(_message);
+	CheckSensorRequest(_message);
+
+#ifdef ENABLE_CONFIG
+	// check if the message is a config.list/current/response
+	CheckConfigRequest(_message, _buffer);
+
+	// call the user defined callback to execute an action, if accepted by the filters
+	if(AfterParseAction != NULL && FilterMatch(_message))
+#else
 	// call the user defined callback to execute an action
 	if(AfterParseAction != NULL)
+#endif
 	{
-	  (*AfterParseAction)(xPLMessage);
+	  (*AfterParseAction)(_message);
 	}
-
-	delete xPLMessage;
 }
 
 /**
  * \brief       Check the xPL message target
- * \details   Check if the xPL message is for us
+ * \details   Check if the xPL message is for us, or for one of our groups
  * \param    _message         an xPL message
  */
 bool xPL::TargetIsMe(xPL_Message * _message)
+{
+#ifdef ENABLE_CONFIG
+  // xpl-group.<name> of one of our groups, resolved by ProcessMessage
+  if (_message->target_group != 0)
+    return true;
+#endif
+
+  return TargetIsDevice(_message);
+}
+
+/**
+ * \brief       Check if the xPL message is for this device, groups excluded
+ * \details   For the hbeat.request and config.* messages, that must not reach every member of a group
+ * \param    _message         an xPL message
+ */
+bool xPL::TargetIsDevice(xPL_Message * _message)
 {
   if (memcmp(_message->target.vendor_id, source.vendor_id, strlen(source.vendor_id)) != 0)
     return false;
@@ -191,63 +519,630 @@ void xPL::SendHBeat()
  */
 inline bool xPL::CheckHBeatRequest(xPL_Message* _message)
 {
-  if (!TargetIsMe(_message))
+  if (!TargetIsDevice(_message))
+    return false;
+
+  return _message->IsSchema_P(PSTR(XPL_HBEAT_REQUEST_CLASS_ID), PSTR(XPL_HBEAT_REQUEST_TYPE_ID));
+}
+
+#ifdef ENABLE_CONFIG
+
+/**
+ * \brief       Filter field comparison, "*" matches anything
+ */
+static bool FieldMatch(const char* _filter, const char* _value)
+{
+  return (_filter[0] == '*' && _filter[1] == '\0') || strcmp(_filter, _value) == 0;
+}
+
+/**
+ * \brief       Parse a filter (msgtype.vendor.device.instance.class.type)
+ * \param    _filter         the result filter
+ * \param    _buffer         the filter
+ * \param    _end            end of the filter, '\n' in a message, '\0' in a command value
+ */
+static bool ParseFilter(struct_xpl_filter* _filter, char* _buffer, char _end)
+{
+  char type[XPL_VENDOR_ID_MAX+1];
+
+  if ((_buffer = scanField(type, _buffer, '.', XPL_VENDOR_ID_MAX)) == NULL
+      || (_buffer = scanField(_filter->source.vendor_id, _buffer, '.', XPL_VENDOR_ID_MAX)) == NULL
+      || (_buffer = scanField(_filter->source.device_id, _buffer, '.', XPL_DEVICE_ID_MAX)) == NULL
+      || (_buffer = scanField(_filter->source.instance_id, _buffer, '.', XPL_INSTANCE_ID_MAX)) == NULL
+      || (_buffer = scanField(_filter->schema.class_id, _buffer, '.', XPL_CLASS_ID_MAX)) == NULL
+      || scanField(_filter->schema.type_id, _buffer, _end, XPL_TYPE_ID_MAX) == NULL)
+  {
+    return false;
+  }
+
+  if (strcmp_P(type, PSTR("xpl-cmnd")) == 0) _filter->type = XPL_CMND;
+  else if (strcmp_P(type, PSTR("xpl-stat")) == 0) _filter->type = XPL_STAT;
+  else if (strcmp_P(type, PSTR("xpl-trig")) == 0) _filter->type = XPL_TRIG;
+  else if (strcmp_P(type, PSTR("*")) == 0) _filter->type = 0;
+  else return false;
+
+  return true;
+}
+
+/**
+ * \brief       Load the configuration saved in EEPROM
+ * \details   To be called in setup(), after SetSource_P. The instance id, heartbeat interval,
+ *            groups and filters received through config.response are restored, so the
+ *            device can announce itself on its first Process().
+ * \return    false if there is no valid configuration (the defaults are kept)
+ */
+bool xPL::LoadConfig()
+{
+  struct_xpl_config config;
+
+  eeprom_read_block(&config, (const void*)XPL_CONFIG_ADDRESS, sizeof(config));
+
+  if (config.magic != XPL_CONFIG_MAGIC || config.version != XPL_CONFIG_VERSION || config.size != sizeof(config))
+    return false;
+
+  memcpy(source.instance_id, config.instance_id, XPL_INSTANCE_ID_MAX + 1);
+  hbeat_interval = config.hbeat_interval;
+  memcpy(group, config.group, sizeof(group));
+  memcpy(filter, config.filter, sizeof(filter));
+
+  return true;
+}
+
+/**
+ * \brief       Save the configuration in EEPROM
+ * \details   Only the changed bytes are written
+ */
+void xPL::SaveConfig()
+{
+  struct_xpl_config config;
+
+  config.magic = XPL_CONFIG_MAGIC;
+  config.version = XPL_CONFIG_VERSION;
+  config.size = sizeof(config);
+  memcpy(config.instance_id, source.instance_id, XPL_INSTANCE_ID_MAX + 1);
+  config.hbeat_interval = hbeat_interval;
+  memcpy(config.group, group, sizeof(group));
+  memcpy(config.filter, filter, sizeof(filter));
+
+  eeprom_update_block(&config, (void*)XPL_CONFIG_ADDRESS, sizeof(config));
+}
+
+/**
+ * \brief       Check if the message is a config request, and answer it
+ * \param    _message         an xPL message
+ * \param    _buffer          the message before parsing, NULL if not received as text
+ */
+bool xPL::CheckConfigRequest(xPL_Message* _message, char* _buffer)
+{
+  // a config.response to a group would give the same identity to every member
+  if (_message->type != XPL_CMND || !TargetIsDevice(_message))
+    return false;
+
+  if (_message->IsSchema_P(PSTR("config"), PSTR("list")))
+  {
+    SendConfigList();
+  }
+  else if (_message->IsSchema_P(PSTR("config"), PSTR("current")))
+  {
+    SendConfigCurrent();
+  }
+  else if (_message->IsSchema_P(PSTR("config"), PSTR("response")))
+  {
+    ApplyConfigResponse(_message, _buffer);
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief       Send the list of the configurable items (config.list)
+ */
+void xPL::SendConfigList()
+{
+  xPL_Message msg;
+  struct_command cmd;
+
+  msg.hop = 1;
+  msg.type = XPL_STAT;
+  msg.SetTarget_P(PSTR("*"));
+  msg.SetSchema_P(PSTR("config"), PSTR("list"));
+
+  msg.AddCommand_P(PSTR("reconf"), PSTR("newconf"));
+  msg.AddCommand_P(PSTR("option"), PSTR("interval"));
+
+  strcpy_P(cmd.name, PSTR("option"));
+  sprintf_P(cmd.value, PSTR("group[%d]"), XPL_CONFIG_GROUP_MAX);
+  msg.AddCommand(cmd.name, cmd.value);
+  sprintf_P(cmd.value, PSTR("filter[%d]"), XPL_CONFIG_FILTER_MAX);
+  msg.AddCommand(cmd.name, cmd.value);
+
+  SendMessage(&msg);
+}
+
+/**
+ * \brief       Send the current configuration (config.current)
+ * \details   The filters are longer than XPL_VALUE_LENGTH_MAX, they are added to the text
+ *            of the message (a filter that does not fit in the buffer is not sent)
+ */
+void xPL::SendConfigCurrent()
+{
+  xPL_Message msg;
+  struct_command cmd;
+  char type[XPL_VENDOR_ID_MAX+1];
+  char buffer[XPL_MESSAGE_BUFFER_MAX];
+  char *end;
+
+  msg.hop = 1;
+  msg.type = XPL_STAT;
+  msg.SetSource(source.vendor_id, source.device_id, source.instance_id);
+  msg.SetTarget_P(PSTR("*"));
+  msg.SetSchema_P(PSTR("config"), PSTR("current"));
+
+  strcpy_P(cmd.name, PSTR("newconf"));
+  msg.AddCommand(cmd.name, source.instance_id);
+
+  strcpy_P(cmd.name, PSTR("interval"));
+  sprintf_P(cmd.value, PSTR("%d"), hbeat_interval);
+  msg.AddCommand(cmd.name, cmd.value);
+
+  strcpy_P(cmd.name, PSTR("group"));
+  for (byte i = 0; i < XPL_CONFIG_GROUP_MAX; i++)
+  {
+    if (group[i][0] == '\0') continue;
+
+    sprintf_P(cmd.value, PSTR(XPL_GROUP_PREFIX "%s"), group[i]);
+    msg.AddCommand(cmd.name, cmd.value);
+  }
+
+  // replace the closing "}\n" with the filters
+  msg.toString(buffer);
+  end = buffer + strlen(buffer) - 2;
+
+  for (byte i = 0; i < XPL_CONFIG_FILTER_MAX; i++)
+  {
+    if (filter[i].schema.class_id[0] == '\0') continue;
+
+    switch (filter[i].type)
+    {
+      case XPL_CMND: strcpy_P(type, PSTR("xpl-cmnd")); break;
+      case XPL_STAT: strcpy_P(type, PSTR("xpl-stat")); break;
+      case XPL_TRIG: strcpy_P(type, PSTR("xpl-trig")); break;
+      default: strcpy_P(type, PSTR("*"));
+    }
+
+    int room = buffer + XPL_MESSAGE_BUFFER_MAX - 2 - end;  // keep 2 bytes for "}\n"
+    int length = snprintf_P(end, room, PSTR("filter=%s.%s.%s.%s.%s.%s\n"), type,
+      filter[i].source.vendor_id, filter[i].source.device_id, filter[i].source.instance_id,
+      filter[i].schema.class_id, filter[i].schema.type_id);
+    if (length >= room)
+      break;
+    end += length;
+  }
+
+  strcpy_P(end, PSTR("}\n"));
+  SendMessage(buffer);
+}
+
+/**
+ * \brief       Apply and save a new configuration (config.response)
+ * \details   Groups and filters not present in the message are removed. The filters are
+ *            read in the message before parsing when there is one, the parsed values being
+ *            cut at XPL_VALUE_LENGTH_MAX characters.
+ * \param    _message         the config.response message
+ * \param    _buffer          the message before parsing, NULL if not received as text
+ */
+void xPL::ApplyConfigResponse(xPL_Message* _message, char* _buffer)
+{
+  byte groups = 0;
+  byte filters = 0;
+
+  memset(group, 0, sizeof(group));
+  memset(filter, 0, sizeof(filter));
+
+  for (byte i = 0; i < _message->command_count; i++)
+  {
+    char *name = _message->command[i].name;
+    char *value = _message->command[i].value;
+
+    if (strcmp_P(name, PSTR("newconf")) == 0)
+    {
+      if (value[0] != '\0' && strlen(value) <= XPL_INSTANCE_ID_MAX)
+      {
+        memcpy(source.instance_id, value, XPL_INSTANCE_ID_MAX + 1);
+      }
+    }
+    else if (strcmp_P(name, PSTR("interval")) == 0)
+    {
+      int interval = atoi(value);
+      if (interval > 0 && interval < 256)
+      {
+        hbeat_interval = interval;
+      }
+    }
+    else if (strcmp_P(name, PSTR("group")) == 0)
+    {
+      if (groups < XPL_CONFIG_GROUP_MAX
+          && memcmp_P(value, PSTR(XPL_GROUP_PREFIX), sizeof(XPL_GROUP_PREFIX) - 1) == 0
+          && strlen(value) - (sizeof(XPL_GROUP_PREFIX) - 1) <= XPL_INSTANCE_ID_MAX)
+      {
+        strcpy(group[groups++], value + sizeof(XPL_GROUP_PREFIX) - 1);
+      }
+    }
+    else if (_buffer == NULL && strcmp_P(name, PSTR("filter")) == 0)
+    {
+      struct_xpl_filter newfilter;
+
+      if (filters < XPL_CONFIG_FILTER_MAX && ParseFilter(&newfilter, value, '\0'))
+      {
+        filter[filters++] = newfilter;
+      }
+    }
+  }
+
+  // the body follows the end of the header, "filter=" can't be found in the header
+  while (_buffer != NULL && filters < XPL_CONFIG_FILTER_MAX && (_buffer = strstr_P(_buffer, PSTR("\nfilter="))) != NULL)
+  {
+    struct_xpl_filter newfilter;
+
+    _buffer += 8;
+    if (ParseFilter(&newfilter, _buffer, '\n'))
+    {
+      filter[filters++] = newfilter;
+    }
+  }
+
+  SaveConfig();
+
+  // announce the new configuration
+  SendHBeat();
+}
+
+/**
+ * \brief       Add a group to the device
+ * \details   The device will accept the messages sent to xpl-group.<name>.
+ *            Call SaveConfig() to keep it.
+ * \param    _name         name of the group (PROGMEM)
+ * \return   false if there is no free group
+ */
+bool xPL::AddGroup_P(const PROGMEM char * _name)
+{
+  for (byte i = 0; i < XPL_CONFIG_GROUP_MAX; i++)
+  {
+    if (group[i][0] == '\0')
+    {
+      strncpy_P(group[i], _name, XPL_INSTANCE_ID_MAX);
+      group[i][XPL_INSTANCE_ID_MAX] = '\0';
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * \brief       Resolve a group name to its bit
+ * \param    _name         name of the group
+ * \return   1 << index of the group, 0 if we are not member of the group
+ */
+byte xPL::GroupMask(char * _name)
+{
+  for (byte i = 0; i < XPL_CONFIG_GROUP_MAX; i++)
+  {
+    if (group[i][0] != '\0' && strcmp(group[i], _name) == 0)
+      return 1 << i;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief       Check the message against the configured filters
+ * \details   Without filter, every message is accepted
+ * \param    _message         an xPL message
+ */
+bool xPL::FilterMatch(xPL_Message* _message)
+{
+  bool empty = true;
+
+  for (byte i = 0; i < XPL_CONFIG_FILTER_MAX; i++)
+  {
+    struct_xpl_filter *f = &filter[i];
+
+    if (f->schema.class_id[0] == '\0') continue;
+    empty = false;
+
+    if ((f->type == 0 || f->type == _message->type)
+        && FieldMatch(f->source.vendor_id, _message->source.vendor_id)
+        && FieldMatch(f->source.device_id, _message->source.device_id)
+        && FieldMatch(f->source.instance_id, _message->source.instance_id)
+        && FieldMatch(f->schema.class_id, _message->schema.class_id)
+        && FieldMatch(f->schema.type_id, _message->schema.type_id))
+    {
+      return true;
+    }
+  }
+
+  return empty;
+}
+#endif
+
+/**
+ * \brief       Compare two ids
+ */
+static bool SameId(struct_id* _id1, struct_id* _id2)
+{
+  return strcmp(_id1->vendor_id, _id2->vendor_id) == 0
+      && strcmp(_id1->device_id, _id2->device_id) == 0
+      && strcmp(_id1->instance_id, _id2->instance_id) == 0;
+}
+
+/**
+ * \brief       millis(), but never 0 (unused entry)
+ */
+static unsigned long CacheTime()
+{
+  unsigned long now = millis();
+  return now != 0 ? now : 1;
+}
+
+/**
+ * \brief       Set the size of the sensor cache
+ * \details   The last sensor.basic value of each source/device/type is kept, and the
+ *            sensor.request sent to these sources or broadcast are answered on their behalf
+ *            while the sources sleep (useful for a gateway). Each entry takes
+ *            sizeof(struct_xpl_sensor_value) bytes of RAM.
+ * \param    _size         number of sensors, 0 = no cache
+ * \return   false if out of memory (no cache)
+ */
+bool xPL::SetSensorCache(byte _size)
+{
+	if(sensor_cache != NULL)
+	{
+		free(sensor_cache);
+		sensor_cache = NULL;
+	}
+	sensor_cache_size = 0;
+
+	if (_size == 0)
+		return true;
+
+	sensor_cache = (struct_xpl_sensor_value*)calloc(_size, sizeof(struct_xpl_sensor_value));
+	if (sensor_cache == NULL)
+		return false;
+
+	sensor_cache_size = _size;
+	return true;
+}
+
+/**
+ * \brief       Keep the value of a sensor.basic stat/trig, and when its source was last awake
+ * \details   The least recently updated sensor is replaced when the cache is full.
+ *            A stat/trig of the source (heartbeat, value, answer...) means it is awake.
+ * \param    _message         an xPL message
+ */
+void xPL::UpdateSensorCache(xPL_Message* _message)
+{
+  if (sensor_cache_size == 0 || _message->type == XPL_CMND)
+    return;
+
+  char *interval = NULL;
+
+  if (_message->type == XPL_STAT
+      && (_message->IsSchema_P(PSTR("hbeat"), PSTR("app")) || _message->IsSchema_P(PSTR("hbeat"), PSTR("basic"))))
+    interval = _message->GetCommandValue_P(PSTR("interval"));
+
+  for (byte i = 0; i < sensor_cache_size; i++)
+  {
+    struct_xpl_sensor_value *cached = &sensor_cache[i];
+
+    if (cached->updated == 0 || !SameId(&cached->source, &_message->source))
+      continue;
+
+    cached->heard = CacheTime();
+    if (interval != NULL && atoi(interval) > 0 && atoi(interval) < 256)
+      cached->interval = atoi(interval);
+  }
+
+  if (!_message->IsSchema_P(PSTR("sensor"), PSTR("basic")))
+    return;
+
+  char *device = _message->GetCommandValue_P(PSTR("device"));
+  char *type = _message->GetCommandValue_P(PSTR("type"));
+  char *current = _message->GetCommandValue_P(PSTR("current"));
+
+  if (device == NULL || current == NULL)
+    return;
+  if (type == NULL)
+    type = (char*)"";
+
+  struct_xpl_sensor_value *entry = NULL;
+  struct_xpl_sensor_value *sibling = NULL;  // other sensor of the same source
+
+  for (byte i = 0; i < sensor_cache_size; i++)
+  {
+    struct_xpl_sensor_value *cached = &sensor_cache[i];
+
+    if (cached->updated != 0 && SameId(&cached->source, &_message->source))
+    {
+      if (strncmp(cached->device, device, XPL_NAME_LENGTH_MAX) == 0
+          && strncmp(cached->type, type, XPL_NAME_LENGTH_MAX) == 0)
+      {
+        entry = cached;
+        break;
+      }
+      sibling = cached;
+    }
+
+    // unused, or least recently updated
+    if (entry == NULL || cached->updated == 0
+        || (entry->updated != 0 && (long)(cached->updated - entry->updated) < 0))
+    {
+      entry = cached;
+    }
+  }
+
+  if (entry->updated == 0 || !SameId(&entry->source, &_message->source))
+  {
+    // new sensor: heartbeat interval of its source, the default one for a new source
+    entry->interval = (sibling != NULL) ? sibling->interval : XPL_DEFAULT_HEARTBEAT_INTERVAL;
+  }
+
+  entry->source = _message->source;
+  strncpy(entry->device, device, XPL_NAME_LENGTH_MAX);
+  entry->device[XPL_NAME_LENGTH_MAX] = '\0';
+  strncpy(entry->type, type, XPL_NAME_LENGTH_MAX);
+  entry->type[XPL_NAME_LENGTH_MAX] = '\0';
+  memcpy(entry->current, current, XPL_VALUE_LENGTH_MAX + 1);
+  entry->updated = CacheTime();
+  entry->heard = entry->updated;  // the source sent this message, it is awake
+}
+
+/**
+ * \brief       Check if the source of a cached sensor sleeps
+ * \details   Asleep when no stat/trig was received from the source for twice its heartbeat
+ *            interval (a heartbeat may be a bit late). A new source is awake until then.
+ */
+bool xPL::SensorAsleep(struct_xpl_sensor_value* _cached)
+{
+  return millis() - _cached->heard > 2000UL * _cached->interval;
+}
+
+/**
+ * \brief       Answer a sensor.request from the sensor cache
+ * \details   The requests sent to a cached source or broadcast are answered for the sources
+ *            that sleep, an awake source answers by itself. The answer is a sensor.basic stat
+ *            sent with the source of the sensor, with the age of the value in seconds.
+ * \param    _message         an xPL message
+ */
+bool xPL::CheckSensorRequest(xPL_Message* _message)
+{
+  bool answered = false;
+
+  if (sensor_cache_size == 0 || _message->type != XPL_CMND || !_message->IsSchema_P(PSTR("sensor"), PSTR("request")))
     return false;
 
-  return _message->IsSchema(XPL_HBEAT_REQUEST_CLASS_ID, XPL_HBEAT_REQUEST_TYPE_ID);
+  bool broadcast = (_message->target.vendor_id[0] == '*');
+  char *device = _message->GetCommandValue_P(PSTR("device"));
+  char *type = _message->GetCommandValue_P(PSTR("type"));
+
+  for (byte i = 0; i < sensor_cache_size; i++)
+  {
+    struct_xpl_sensor_value *cached = &sensor_cache[i];
+
+    if (cached->updated == 0
+        || !(broadcast || SameId(&cached->source, &_message->target))
+        || !SensorAsleep(cached)
+        || (device != NULL && strncmp(cached->device, device, XPL_NAME_LENGTH_MAX) != 0)
+        || (type != NULL && strncmp(cached->type, type, XPL_NAME_LENGTH_MAX) != 0))
+      continue;
+
+    xPL_Message msg;
+    struct_command cmd;
+
+    msg.hop = 1;
+    msg.type = XPL_STAT;
+    msg.source = cached->source;
+    msg.SetTarget_P(PSTR("*"));
+    msg.SetSchema_P(PSTR("sensor"), PSTR("basic"));
+
+    strcpy_P(cmd.name, PSTR("device"));
+    msg.AddCommand(cmd.name, cached->device);
+    if (cached->type[0] != '\0')
+    {
+      strcpy_P(cmd.name, PSTR("type"));
+      msg.AddCommand(cmd.name, cached->type);
+    }
+    strcpy_P(cmd.name, PSTR("current"));
+    msg.AddCommand(cmd.name, cached->current);
+    strcpy_P(cmd.name, PSTR("age"));
+    sprintf_P(cmd.value, PSTR("%lu"), (millis() - cached->updated) / 1000);
+    msg.AddCommand(cmd.name, cmd.value);
+
+    SendMessage(&msg, false);
+    answered = true;
+  }
+
+  return answered;
+}
+
+/**
+ * \brief       Priority of an ingoing message
+ * \details   Only the message type and the schema class are checked, the message is not parsed.
+ *            Every xpl-cmnd is above every xpl-stat/trig.
+ * \param    _buffer         the message
+ */
+byte xPL::InputPriority(char* _buffer)
+{
+    if (memcmp_P(_buffer, PSTR("xpl-trig"), 8) == 0)
+        return XPL_PRIORITY_NORMAL;
+
+    if (memcmp_P(_buffer, PSTR("xpl-cmnd"), 8) != 0)
+        return XPL_PRIORITY_LOW;
+
+    // the schema follows the end of the header
+    char *schema = strstr_P(_buffer, PSTR("}\n"));
+    if (schema != NULL)
+    {
+        schema += 2;
+
+        if (memcmp_P(schema, PSTR("lighting."), 9) == 0
+            || memcmp_P(schema, PSTR("control."), 8) == 0
+            || memcmp_P(schema, PSTR("x10."), 4) == 0)
+            return XPL_PRIORITY_HIGH;
+    }
+
+    return XPL_PRIORITY_CMND;
 }
 
 /**
  * \brief       Parse a buffer and generate a xPL_Message
- * \details	  Line based xPL parser
+ * \details	  Line based xPL parser, the message is not handled (see ProcessMessage)
  * \param    _xPLMessage    the result xPL message
  * \param    _message         the buffer
  */
 void xPL::Parse(xPL_Message* _xPLMessage, char* _buffer)
 {
-    int len = strlen(_buffer);
-
-    byte j=0;
+    byte j;
     byte line=0;
     int result=0;
     char lineBuffer[XPL_LINE_MESSAGE_BUFFER_MAX+1];
+    char *eol;
 
-    // read each character of the message
-    for(byte i = 0; i < len; i++)
+    // jump from linefeed to linefeed with strchr (word/vector scan in the libc)
+    // instead of copying the message byte by byte
+    while((eol = strchr(_buffer, XPL_END_OF_LINE)) != NULL) // is there a linefeed (ASCII: 10 decimal)
     {
-        // load byte by byte in 'line' buffer, until '\n' is detected
-        if(_buffer[i] == XPL_END_OF_LINE) // is it a linefeed (ASCII: 10 decimal)
+        ++line;
+
+        // load the whole line in 'line' buffer
+        j = min(eol - _buffer, XPL_LINE_MESSAGE_BUFFER_MAX);
+        memcpy(lineBuffer, _buffer, j);
+        lineBuffer[j]='\0';	// add the end of string id
+
+        if(line <= XPL_OPEN_SCHEMA)
         {
-            ++line;
-            lineBuffer[j]='\0';	// add the end of string id
-
-            if(line <= XPL_OPEN_SCHEMA)
-            {
-                // first part: header and schema determination
-            	// we analyse the line, function of the line number in the xpl message
-                result = AnalyseHeaderLine(_xPLMessage, lineBuffer ,line);
-            }
-
-            if(line > XPL_OPEN_SCHEMA)
-            {
-                // second part: command line
-            	// we analyse the specific command line, function of the line number in the xpl message
-                result = AnalyseCommandLine(_xPLMessage, lineBuffer, line-9, j);
-
-                if(result == _xPLMessage->command_count+1)
-                    break;
-            }
-
-            if (result < 0) break;
-
-            j = 0; // reset the buffer pointer
-            clearStr(lineBuffer); // clear the buffer
+            // first part: header and schema determination
+        	// we analyse the line, function of the line number in the xpl message
+            result = AnalyseHeaderLine(_xPLMessage, lineBuffer ,line);
         }
-        else
+
+        if(line > XPL_OPEN_SCHEMA)
         {
-            // next character
-        	lineBuffer[j++] = _buffer[i];
+            // second part: command line
+        	// we analyse the specific command line, function of the line number in the xpl message
+            result = AnalyseCommandLine(_xPLMessage, lineBuffer, line-9, j);
+
+            if(result == _xPLMessage->command_count+1)
+                break;
         }
+
+        if (result < 0) break;
+
+        _buffer = eol + 1; // next line
     }
 }
 
@@ -313,7 +1208,10 @@ byte xPL::AnalyseHeaderLine(xPL_Message* _xPLMessage, char* _buffer, byte _line)
 			break;
 
 		case XPL_SOURCE: //source
-			if (sscanf_P(_buffer, XPL_SOURCE_PARSER, &_xPLMessage->source.vendor_id, &_xPLMessage->source.device_id, &_xPLMessage->source.instance_id) == 3)
+			if (memcmp_P(_buffer,PSTR("source="),7)==0
+				&& (_buffer = scanField(_xPLMessage->source.vendor_id, _buffer+7, '-', XPL_VENDOR_ID_MAX)) != NULL
+				&& (_buffer = scanField(_xPLMessage->source.device_id, _buffer, '.', XPL_DEVICE_ID_MAX)) != NULL
+				&& scanField(_xPLMessage->source.instance_id, _buffer, '\0', XPL_INSTANCE_ID_MAX) != NULL)
 			{
 			  return 4;
 			}
@@ -326,20 +1224,26 @@ byte xPL::AnalyseHeaderLine(xPL_Message* _xPLMessage, char* _buffer, byte _line)
 
 		case XPL_TARGET: //target
 
-			if (sscanf_P(_buffer, XPL_TARGET_PARSER, &_xPLMessage->target.vendor_id, &_xPLMessage->target.device_id, &_xPLMessage->target.instance_id) == 3)
+			if (memcmp_P(_buffer,PSTR("target="),7)!=0)
+			{
+			  return -5;
+			}
+
+			if(memcmp(_buffer+7,"*", 1) == 0)  // check if broadcast message
+			{
+			  memcpy(_xPLMessage->target.vendor_id, "*", 2);
+			  return 5;
+			}
+
+			if ((_buffer = scanField(_xPLMessage->target.vendor_id, _buffer+7, '-', XPL_VENDOR_ID_MAX)) != NULL
+				&& (_buffer = scanField(_xPLMessage->target.device_id, _buffer, '.', XPL_DEVICE_ID_MAX)) != NULL
+				&& scanField(_xPLMessage->target.instance_id, _buffer, '\0', XPL_INSTANCE_ID_MAX) != NULL)
 			{
 			  return 5;
 			}
 			else
 			{
-			  if(memcmp(_xPLMessage->target.vendor_id,"*", 1) == 0)  // check if broadcast message
-			  {
-				  return 5;
-			  }
-			  else
-			  {
-				  return -5;
-			  }
+			  return -5;
 			}
 			break;
 
@@ -356,7 +1260,10 @@ byte xPL::AnalyseHeaderLine(xPL_Message* _xPLMessage, char* _buffer, byte _line)
 			break;
 
 		case XPL_SCHEMA_IDENTIFIER: //schema
-			sscanf_P(_buffer, XPL_SCHEMA_PARSER, &_xPLMessage->schema.class_id, &_xPLMessage->schema.type_id);
+			if ((_buffer = scanField(_xPLMessage->schema.class_id, _buffer, '.', XPL_CLASS_ID_MAX)) != NULL)
+			{
+				scanField(_xPLMessage->schema.type_id, _buffer, '\0', XPL_TYPE_ID_MAX);
+			}
 			return 7;
 
 			break;
@@ -392,8 +1299,21 @@ byte xPL::AnalyseCommandLine(xPL_Message * _xPLMessage, char *_buffer, byte _com
     else	// parse the next command
     {
     	struct_command newcmd;
-		
-		sscanf_P(_buffer, XPL_COMMAND_PARSER, &newcmd.name, &newcmd.value);
+    	char *value = (char*)memchr(_buffer, '=', line_length);
+
+    	if (value == NULL) // not a name=value pair
+    	{
+    		return _command_line;
+    	}
+
+    	byte length = min(value - _buffer, XPL_NAME_LENGTH_MAX);
+    	memcpy(newcmd.name, _buffer, length);
+    	newcmd.name[length] = '\0';
+
+    	value++;
+    	length = min(line_length - (value - _buffer), XPL_VALUE_LENGTH_MAX);
+    	memcpy(newcmd.value, value, length);
+    	newcmd.value[length] = '\0';
 
         _xPLMessage->AddCommand(newcmd.name, newcmd.value);
 
@@ -28,7 +28,12 @@
 #ifndef xPL_h
 #define xPL_h
  
+#ifndef XPL_NO_PARSING
 #define ENABLE_PARSING 1
+#endif
+#if defined(ENABLE_PARSING) && !defined(XPL_NO_CONFIG) && defined(__AVR__)
+#define ENABLE_CONFIG 1     // config.* schemas, needs ENABLE_PARSING and the EEPROM of avr-libc
+#endif
 
 #include "Arduino.h"
 #include "xPL_utils.h"
@@ -45,12 +50,76 @@
 #define XPL_PORT_L  0x19
 #define XPL_PORT_H  0xF
 
+#define XPL_SEND_CHUNK_SIZE     64      // bytes given to SendChunk by each Process()
+
+#define XPL_LINK_UP_DELAY       3000    // ms before the first heartbeat, when there is no LinkUp callback
+
+#ifndef XPL_CONFIG_ADDRESS
+#define XPL_CONFIG_ADDRESS      0       // EEPROM address of the configuration record, sizeof(struct_xpl_config) bytes
+#endif
+#define XPL_CONFIG_MAGIC        0x78    // 'x'
+#define XPL_CONFIG_VERSION      1       // to increase when struct_xpl_config changes
+#define XPL_CONFIG_GROUP_MAX    2       // 8 max, one bit each in xPL_Message::target_group
+#define XPL_CONFIG_FILTER_MAX   2
+
+#if XPL_CONFIG_GROUP_MAX > 8
+#error XPL_CONFIG_GROUP_MAX must be 8 or less (one bit per group in xPL_Message::target_group)
+#endif
+
 typedef enum {XPL_ACCEPT_ALL, XPL_ACCEPT_SELF, XPL_ACCEPT_SELF_ANY} xpl_accepted_type;
 // XPL_ACCEPT_ALL = all xpl messages
 // XPL_ACCEPT_SELF = only for me
 // XPL_ACCEPT_SELF_ANY = only for me and any (*)
 
+#define XPL_PRIORITY_LOW        0   // xpl-stat
+#define XPL_PRIORITY_NORMAL     1   // xpl-trig
+#define XPL_PRIORITY_CMND       2   // xpl-cmnd, other schemas (hbeat.request, config.*, sensor.request...)
+#define XPL_PRIORITY_HIGH       3   // xpl-cmnd lighting.*, control.*, x10.*
+#define XPL_PRIORITY_COUNT      4
+
+typedef enum {XPL_DROP_NEWEST, XPL_DROP_LOWEST_OLDEST} xpl_drop_policy;
+// XPL_DROP_NEWEST = input queue full: drop the incoming message
+// XPL_DROP_LOWEST_OLDEST = input queue full: drop the oldest stat/trig of the lowest priority.
+//                          A queued cmnd is only replaced by a cmnd of a higher priority,
+//                          else the incoming message is dropped (a stat/trig never replaces a cmnd)
+
+typedef struct struct_xpl_config struct_xpl_config;
+struct struct_xpl_config			// configuration record saved in EEPROM
+{
+    byte magic;
+    byte version;
+    unsigned short size;
+    char instance_id[XPL_INSTANCE_ID_MAX+1];
+    byte hbeat_interval;
+    char group[XPL_CONFIG_GROUP_MAX][XPL_INSTANCE_ID_MAX+1];
+    struct_xpl_filter filter[XPL_CONFIG_FILTER_MAX];
+};
+
+typedef struct struct_xpl_queued struct_xpl_queued;
+struct struct_xpl_queued			// ingoing message waiting in the input queue
+{
+    byte used;
+    byte priority;
+    unsigned int order;				// arrival order
+    char buffer[XPL_MESSAGE_BUFFER_MAX];
+};
+
+typedef struct struct_xpl_sensor_value struct_xpl_sensor_value;
+struct struct_xpl_sensor_value		// last known value of a sensor, to answer sensor.request
+{
+    struct_id source;
+    char device[XPL_NAME_LENGTH_MAX+1];
+    char type[XPL_NAME_LENGTH_MAX+1];
+    char current[XPL_VALUE_LENGTH_MAX+1];
+    unsigned long updated;			// millis() of the last sensor.basic, 0 = unused
+    unsigned long heard;			// millis() of the last stat/trig of the source (heartbeat, value...)
+    byte interval;					// heartbeat interval of the source, in seconds like hbeat_interval
+};
+
 typedef void (*xPLSendExternal)(char*);
+typedef bool (*xPLLinkUp)();
+typedef void (*xPLSendChunk)(char* chunk, byte length, bool first, bool last);
+typedef void (*xPLAfterSendAction)(char*);
 typedef void (*xPLAfterParseAction)(xPL_Message * message);
 
 class xPL
@@ -78,19 +147,76 @@ class xPL
     byte hbeat_interval;  // default 5
     xpl_accepted_type xpl_accepted;
 
+    xPLLinkUp LinkUp;     // optional, the first heartbeat is sent as soon as it returns true
+
+
+    xpl_drop_policy drop_policy;                       // default XPL_DROP_LOWEST_OLDEST
+    unsigned int dropped[XPL_PRIORITY_COUNT];           // dropped messages, by priority
 
     void Process();
     void ParseInputMessage(char *buffer);
+    void ProcessMessage(xPL_Message *message, char *buffer = NULL);
+    void Parse(xPL_Message *, char *);
+
+    bool SetInputQueue(byte);
+    void QueueInputMessage(char *buffer);
+
+    bool SetSensorCache(byte);
+
+    // asynchronous send: SendMessage only copies the message, Process() sends it
+    xPLSendChunk SendChunk;                 // optional, else SendExternal sends the whole message
+    xPLAfterSendAction AfterSendAction;     // optional, called when a message is sent
+
+    bool SetAsyncSend(bool);
+    void FlushSend();
 
     bool TargetIsMe(xPL_Message * message);
 
+#ifdef ENABLE_CONFIG
+    char group[XPL_CONFIG_GROUP_MAX][XPL_INSTANCE_ID_MAX+1];  // my groups (xpl-group.<name>)
+    struct_xpl_filter filter[XPL_CONFIG_FILTER_MAX];          // accepted messages, none = all
+
+    bool LoadConfig();
+    void SaveConfig();
+
+    bool AddGroup_P(const PROGMEM char *);
+#endif
+
   private:
     //void ClearData();
     unsigned long last_heartbeat;
+
+    struct_xpl_queued *input_queue;
+    byte input_queue_size;
+    unsigned int input_order;
+    byte InputPriority(char *);
+
+    struct_xpl_sensor_value *sensor_cache;
+    byte sensor_cache_size;
+    void UpdateSensorCache(xPL_Message * message);
+    bool CheckSensorRequest(xPL_Message * message);
+    bool SensorAsleep(struct_xpl_sensor_value *);
+
+    char *send_buffer;                      // 2 x XPL_MESSAGE_BUFFER_MAX
+    bool send_pending[2];
+    byte send_active;                       // oldest pending buffer, sent first
+    unsigned int send_position;
+    char *FreeSendBuffer();
+    void SendNextChunk();
+
     void SendHBeat();
     bool CheckHBeatRequest(xPL_Message * message);
+    bool TargetIsDevice(xPL_Message * message);
+
+#ifdef ENABLE_CONFIG
+    bool CheckConfigRequest(xPL_Message * message, char * buffer);
+    void SendConfigList();
+    void SendConfigCurrent();
+    void ApplyConfigResponse(xPL_Message * message, char * buffer);
+    bool FilterMatch(xPL_Message * message);
+    byte GroupMask(char *);
+#endif
 
-	void Parse(xPL_Message *, char *);
 	byte AnalyseHeaderLine(xPL_Message *, char *, byte );
     byte AnalyseCommandLine(xPL_Message *, char *, byte, byte );
 #endif
@@ -0,0 +1,154 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include "xPL_Aggregator.h"
+
+/**
+ * \brief       Create an aggregator for one sensor
+ * \param    _xpl           xPL instance used to send the messages
+ * \param    _device        device name (PROGMEM)
+ * \param    _type          sensor type, temp, humidity... (PROGMEM)
+ */
+xPL_Aggregator::xPL_Aggregator(xPL * _xpl, const PROGMEM char * _device, const PROGMEM char * _type)
+{
+	xpl = _xpl;
+	device = _device;
+	type = _type;
+
+	deadband = 0;
+	window = 0;
+	decimals = XPL_AGGREGATOR_DEFAULT_DECIMALS;
+
+	last = 0;
+	last_sent = 0;
+	sent_once = false;
+
+	ResetWindow();
+}
+
+/**
+ * \brief       Add a reading
+ * \details	  Update the window statistics and send a trig on significant change
+ * \param    _value         the reading
+ */
+void xPL_Aggregator::Update(float _value)
+{
+	last = _value;
+
+	if (count == 0 || _value < lowest) lowest = _value;
+	if (count == 0 || _value > highest) highest = _value;
+	sum += _value;
+	count++;
+
+	if (!sent_once || fabs(_value - last_sent) > deadband)
+	{
+		Send(XPL_TRIG);
+		last_sent = _value;
+		sent_once = true;
+	}
+}
+
+/**
+ * \brief       Send the stat message at the end of the window
+ * \details	  To be called in the loop, like xPL::Process
+ */
+void xPL_Aggregator::Process()
+{
+	if (window == 0 || millis() - window_start < window)
+		return;
+
+	if (count > 0)
+	{
+		Send(XPL_STAT);
+	}
+
+	ResetWindow();
+}
+
+/**
+ * \brief       Average of the readings of the current window
+ */
+float xPL_Aggregator::Average()
+{
+	return count > 0 ? sum / count : last;
+}
+
+/**
+ * \brief       Start a new window
+ */
+void xPL_Aggregator::ResetWindow()
+{
+	window_start = millis();
+	sum = 0;
+	count = 0;
+	lowest = last;
+	highest = last;
+}
+
+/**
+ * \brief       Send a sensor.basic message
+ * \param    _type          XPL_TRIG (current value) or XPL_STAT (window statistics)
+ */
+void xPL_Aggregator::Send(short _type)
+{
+	xPL_Message msg;
+
+	msg.hop = 1;
+	msg.type = _type;
+
+	msg.SetTarget_P(PSTR("*"));
+	msg.SetSchema_P(PSTR("sensor"), PSTR("basic"));
+
+	msg.AddCommand_P(PSTR("device"), device);
+	msg.AddCommand_P(PSTR("type"), type);
+	AddValue(&msg, PSTR("current"), last);
+
+	if (_type == XPL_STAT)
+	{
+		AddValue(&msg, PSTR("lowest"), lowest);
+		AddValue(&msg, PSTR("highest"), highest);
+		AddValue(&msg, PSTR("average"), Average());
+	}
+
+	xpl->SendMessage(&msg);
+}
+
+/**
+ * \brief       Add a numeric command to the message
+ * \param    _message       the message
+ * \param    _name          name of the command (PROGMEM)
+ * \param    _value         value of the command
+ */
+void xPL_Aggregator::AddValue(xPL_Message * _message, const PROGMEM char * _name, float _value)
+{
+	struct_command cmd;
+
+	strcpy_P(cmd.name, _name);
+	dtostrf(_value, 1, decimals, cmd.value);
+
+	_message->AddCommand(cmd.name, cmd.value);
+}
@@ -0,0 +1,74 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef xPLAggregator_h
+#define xPLAggregator_h
+ 
+#include "Arduino.h"
+#include "xPL.h"
+
+#define XPL_AGGREGATOR_DEFAULT_DECIMALS  1
+
+// Aggregates the readings of one sensor (device + type) and reports them
+// as sensor.basic messages:
+// - an xpl-trig when the value moves by more than 'deadband' from the last value sent
+// - an xpl-stat with current/lowest/highest/average at the end of every 'window'
+class xPL_Aggregator
+{
+    public:
+        xPL_Aggregator(xPL *, const PROGMEM char *, const PROGMEM char *);
+
+        float deadband;             // minimum change to send a trig (0 = every change)
+        unsigned long window;       // stat period in ms (0 = no stat)
+        byte decimals;              // decimals sent in the messages
+
+        float last;                 // last reading
+        float lowest;               // lowest reading of the window
+        float highest;              // highest reading of the window
+
+        void Update(float);
+        void Process();
+
+        float Average();
+
+    private:
+        xPL *xpl;
+        const char *device;         // PROGMEM device name
+        const char *type;           // PROGMEM sensor type
+
+        float sum;
+        unsigned int count;
+        float last_sent;
+        bool sent_once;
+        unsigned long window_start;
+
+        void ResetWindow();
+        void Send(short);
+        void AddValue(xPL_Message *, const PROGMEM char *, float);
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include "xPL_Log.h"
+
+/**
+ * \brief       Bit of a string in the index bitmaps
+ */
+uint16_t logHashBit (const char* str)
+{
+    byte hash = 0;
+    while (*str) hash = hash * 31 + *str++;
+    return 1 << (hash & 0x0F);
+}
+
+/**
+ * \brief       Write the header of a record
+ * \param    header         output, XPL_LOG_RECORD_HEADER bytes
+ * \param    time           time of the record
+ * \param    length         length of the binary message following the header
+ */
+void logWriteRecordHeader (byte* header, uint32_t time, uint16_t length)
+{
+    for (byte i = 0; i < 4; i++) header[i] = time >> (8 * i);
+    header[4] = length;
+    header[5] = length >> 8;
+}
+
+/**
+ * \brief       Read the header of a record
+ * \param    header         XPL_LOG_RECORD_HEADER bytes
+ */
+void logReadRecordHeader (const byte* header, uint32_t* time, uint16_t* length)
+{
+    *time = 0;
+    for (byte i = 0; i < 4; i++) *time |= (uint32_t)header[i] << (8 * i);
+    *length = header[4] | (uint16_t)header[5] << 8;
+}
+
+/**
+ * \brief       Write an index entry
+ * \param    data           output, XPL_LOG_INDEX_ENTRY bytes
+ */
+void logWriteIndex (byte* data, const struct_xpl_log_index* entry)
+{
+    for (byte i = 0; i < 4; i++)
+    {
+        data[i] = entry->time >> (8 * i);
+        data[4 + i] = entry->offset >> (8 * i);
+    }
+    data[8] = entry->sources;
+    data[9] = entry->sources >> 8;
+    data[10] = entry->schemas;
+    data[11] = entry->schemas >> 8;
+}
+
+/**
+ * \brief       Read an index entry
+ * \param    data           XPL_LOG_INDEX_ENTRY bytes
+ */
+void logReadIndex (const byte* data, struct_xpl_log_index* entry)
+{
+    entry->time = 0;
+    entry->offset = 0;
+    for (byte i = 0; i < 4; i++)
+    {
+        entry->time |= (uint32_t)data[i] << (8 * i);
+        entry->offset |= (uint32_t)data[4 + i] << (8 * i);
+    }
+    entry->sources = data[8] | (uint16_t)data[9] << 8;
+    entry->schemas = data[10] | (uint16_t)data[11] << 8;
+}
+
+/**
+ * \brief       Create a query
+ * \param    _from          time of the oldest record
+ * \param    _source        instance id of the source (optional)
+ * \param    _class         schema class (optional)
+ */
+xPL_LogQuery::xPL_LogQuery(uint32_t _from, const char * _source, const char * _class)
+{
+	from = _from;
+	source = _source;
+	class_id = _class;
+	source_bit = _source ? logHashBit(_source) : 0xFFFF;
+	schema_bit = _class ? logHashBit(_class) : 0xFFFF;
+}
+
+/**
+ * \brief       Check if a block may contain records of the query
+ * \param    _block         index entry of the block
+ * \param    _next          index entry of the next block, NULL for the last block
+ */
+bool xPL_LogQuery::BlockMatch(const struct_xpl_log_index * _block, const struct_xpl_log_index * _next)
+{
+	// the records of a block are older than the next block
+	if (_next != NULL && _next->time < from)
+		return false;
+
+	return (_block->sources & source_bit) && (_block->schemas & schema_bit);
+}
+
+/**
+ * \brief       Check if a record is selected by the query
+ * \param    _time          time of the record
+ * \param    _message       message of the record (see xPL_Message::fromBinary)
+ */
+bool xPL_LogQuery::RecordMatch(uint32_t _time, xPL_Message * _message)
+{
+	return _time >= from
+		&& (source == NULL || strcmp(_message->source.instance_id, source) == 0)
+		&& (class_id == NULL || strcmp(_message->schema.class_id, class_id) == 0);
+}
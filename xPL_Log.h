@@ -0,0 +1,81 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef xPLLog_h
+#define xPLLog_h
+ 
+#include "Arduino.h"
+#include "xPL_Message.h"
+
+// Log of binary xPL messages (see the xPL_Logger_SD example). The fields are
+// little-endian whatever the machine, a log written by an Arduino can be read
+// on a computer with the same library files.
+//   record        uint32  time (ms)
+//                 uint16  length of the binary message
+//                 n bytes binary message (see xPL_Message::toBinary)
+//   index entry   uint32  time of the first record of the block
+//                 uint32  offset of the block in the log
+//                 uint16  bitmap of the sources of the block (bit = hash of the instance id)
+//                 uint16  bitmap of the schemas of the block (bit = hash of the class)
+// A block ends where the next one starts, or at the end of the log.
+#define XPL_LOG_RECORD_HEADER    6
+#define XPL_LOG_INDEX_ENTRY      12
+
+typedef struct struct_xpl_log_index struct_xpl_log_index;
+struct struct_xpl_log_index		// index entry of a block of records
+{
+    uint32_t time;
+    uint32_t offset;
+    uint16_t sources;
+    uint16_t schemas;
+};
+
+uint16_t logHashBit (const char* str);
+void logWriteRecordHeader (byte* header, uint32_t time, uint16_t length);
+void logReadRecordHeader (const byte* header, uint32_t* time, uint16_t* length);
+void logWriteIndex (byte* data, const struct_xpl_log_index* entry);
+void logReadIndex (const byte* data, struct_xpl_log_index* entry);
+
+// Selection of the records of a log: received since a time, of a source instance
+// and of a schema class. The index skips the blocks that can't contain them.
+class xPL_LogQuery
+{
+    public:
+        xPL_LogQuery(uint32_t, const char * = NULL, const char * = NULL);
+
+        bool BlockMatch(const struct_xpl_log_index *, const struct_xpl_log_index *);
+        bool RecordMatch(uint32_t, xPL_Message *);
+
+    private:
+        uint32_t from;
+        const char *source;         // instance id, NULL = all
+        const char *class_id;       // schema class, NULL = all
+        uint16_t source_bit;
+        uint16_t schema_bit;
+};
+
+#endif
@@ -27,10 +27,124 @@
  
 #include "xPL_Message.h"
 
+// Dictionary of the binary format, words replaced by their index
+// Only add words at the end, the index is stored in the records
+const char xpl_word_0[] PROGMEM = "*";
+const char xpl_word_1[] PROGMEM = "xpl";
+const char xpl_word_2[] PROGMEM = "group";
+const char xpl_word_3[] PROGMEM = "hbeat";
+const char xpl_word_4[] PROGMEM = "config";
+const char xpl_word_5[] PROGMEM = "sensor";
+const char xpl_word_6[] PROGMEM = "x10";
+const char xpl_word_7[] PROGMEM = "lighting";
+const char xpl_word_8[] PROGMEM = "control";
+const char xpl_word_9[] PROGMEM = "basic";
+const char xpl_word_10[] PROGMEM = "app";
+const char xpl_word_11[] PROGMEM = "request";
+const char xpl_word_12[] PROGMEM = "end";
+const char xpl_word_13[] PROGMEM = "list";
+const char xpl_word_14[] PROGMEM = "current";
+const char xpl_word_15[] PROGMEM = "response";
+const char xpl_word_16[] PROGMEM = "device";
+const char xpl_word_17[] PROGMEM = "type";
+const char xpl_word_18[] PROGMEM = "command";
+const char xpl_word_19[] PROGMEM = "level";
+const char xpl_word_20[] PROGMEM = "network";
+const char xpl_word_21[] PROGMEM = "interval";
+const char xpl_word_22[] PROGMEM = "port";
+const char xpl_word_23[] PROGMEM = "remote-ip";
+const char xpl_word_24[] PROGMEM = "version";
+const char xpl_word_25[] PROGMEM = "1.0";
+const char xpl_word_26[] PROGMEM = "temp";
+const char xpl_word_27[] PROGMEM = "humidity";
+const char xpl_word_28[] PROGMEM = "on";
+const char xpl_word_29[] PROGMEM = "off";
+const char xpl_word_30[] PROGMEM = "goto";
+const char xpl_word_31[] PROGMEM = "lowest";
+const char xpl_word_32[] PROGMEM = "highest";
+const char xpl_word_33[] PROGMEM = "average";
+const char xpl_word_34[] PROGMEM = "newconf";
+const char xpl_word_35[] PROGMEM = "option";
+const char xpl_word_36[] PROGMEM = "reconf";
+const char xpl_word_37[] PROGMEM = "filter";
+
+const char * const xpl_dictionary[] PROGMEM =
+{
+	xpl_word_0, xpl_word_1, xpl_word_2, xpl_word_3, xpl_word_4, xpl_word_5, xpl_word_6, xpl_word_7,
+	xpl_word_8, xpl_word_9, xpl_word_10, xpl_word_11, xpl_word_12, xpl_word_13, xpl_word_14, xpl_word_15,
+	xpl_word_16, xpl_word_17, xpl_word_18, xpl_word_19, xpl_word_20, xpl_word_21, xpl_word_22, xpl_word_23,
+	xpl_word_24, xpl_word_25, xpl_word_26, xpl_word_27, xpl_word_28, xpl_word_29, xpl_word_30, xpl_word_31,
+	xpl_word_32, xpl_word_33, xpl_word_34, xpl_word_35, xpl_word_36, xpl_word_37
+};
+
+#define XPL_DICTIONARY_SIZE  (sizeof(xpl_dictionary) / sizeof(xpl_dictionary[0]))
+
+/**
+ * \brief       Write a string of the binary format
+ * \param    _buffer         output position
+ * \param    _end            end of the output buffer
+ * \param    _str            the string
+ * \return   next output position, NULL if the buffer is too small
+ */
+static byte* WriteBinaryString(byte *_buffer, byte *_end, const char *_str)
+{
+	for (byte i = 0; i < XPL_DICTIONARY_SIZE; i++)
+	{
+		if (strcmp_P(_str, (const char*)pgm_read_ptr(&xpl_dictionary[i])) == 0)
+		{
+			if (_buffer >= _end) return NULL;
+			*_buffer++ = XPL_BINARY_DICTIONARY_FLAG | i;
+			return _buffer;
+		}
+	}
+
+	byte length = strlen(_str);
+	if (_buffer + 1 + length > _end) return NULL;
+
+	*_buffer++ = length;
+	memcpy(_buffer, _str, length);
+	return _buffer + length;
+}
+
+/**
+ * \brief       Read a string of the binary format
+ * \param    _str            the string, at least _max+1 bytes
+ * \param    _buffer         input position
+ * \param    _end            end of the input buffer
+ * \param    _max            maximum length of the string
+ * \return   next input position, NULL if the record is invalid
+ */
+static const byte* ReadBinaryString(char *_str, const byte *_buffer, const byte *_end, byte _max)
+{
+	if (_buffer >= _end) return NULL;
+
+	byte length = *_buffer++;
+
+	if (length & XPL_BINARY_DICTIONARY_FLAG)
+	{
+		length &= ~XPL_BINARY_DICTIONARY_FLAG;
+		if (length >= XPL_DICTIONARY_SIZE) return NULL;
+
+		const char *word = (const char*)pgm_read_ptr(&xpl_dictionary[length]);
+		if (strlen_P(word) > _max) return NULL;
+
+		strcpy_P(_str, word);
+		return _buffer;
+	}
+
+	if (length > _max || _buffer + length > _end) return NULL;
+
+	memcpy(_str, _buffer, length);
+	_str[length] = '\0';
+	return _buffer + length;
+}
+
 xPL_Message::xPL_Message()
 {
     command = NULL;
 	command_count = 0;
+	target_group = 0;
+	hop = 1;
 }
 
 xPL_Message::~xPL_Message()
@@ -139,10 +253,24 @@ bool xPL_Message::AddCommand(char* _name, char* _value)
 
 /**
  * \brief       Convert xPL_Message to char* buffer
+ * \details	  The buffer is shared by all the messages and overwritten by the next call,
+ *            it takes XPL_MESSAGE_BUFFER_MAX bytes of RAM in the sketches that use it.
+ * \deprecated use toString(char *) with a buffer of the caller
  */
 char* xPL_Message::toString()
 {
-  char message_buffer[XPL_MESSAGE_BUFFER_MAX];
+  static char message_buffer[XPL_MESSAGE_BUFFER_MAX];
+
+  return toString(message_buffer);
+}
+
+/**
+ * \brief       Convert xPL_Message to text in the given buffer
+ * \details	  The commands that do not fit in the buffer are left out
+ * \param    message_buffer   output buffer, XPL_MESSAGE_BUFFER_MAX bytes
+ */
+char* xPL_Message::toString(char *message_buffer)
+{
   int pos;
 
   clearStr(message_buffer);
@@ -160,7 +288,7 @@ char* xPL_Message::toString()
       break;
   }
 
-  pos += sprintf_P(message_buffer + pos, PSTR("\n{\nhop=1\nsource=%s-%s.%s\ntarget="), source.vendor_id, source.device_id, source.instance_id);
+  pos += sprintf_P(message_buffer + pos, PSTR("\n{\nhop=%d\nsource=%s-%s.%s\ntarget="), hop, source.vendor_id, source.device_id, source.instance_id);
 
   if(memcmp(target.vendor_id,"*", 1) == 0)  // check if broadcast message
   {
@@ -175,7 +303,11 @@ char* xPL_Message::toString()
 
   for (byte i=0; i<command_count; i++)
   {
-	pos += sprintf_P(message_buffer + pos, PSTR("%s=%s\n"), command[i].name, command[i].value);
+	int room = XPL_MESSAGE_BUFFER_MAX - 3 - pos;  // keep 3 bytes for "}\n"
+	int length = snprintf_P(message_buffer + pos, room, PSTR("%s=%s\n"), command[i].name, command[i].value);
+	if (length >= room)
+	  break;
+	pos += length;
   }
 
   sprintf_P(message_buffer + pos, PSTR("}\n"));
@@ -183,6 +315,100 @@ char* xPL_Message::toString()
   return message_buffer;
 }
 
+/**
+ * \brief       Convert xPL_Message to a compact binary record
+ * \details	  See the format in xPL_Message.h
+ * \param    _buffer         output buffer
+ * \param    _size           size of the output buffer
+ * \return   length of the record, 0 if the buffer is too small
+ */
+unsigned int xPL_Message::toBinary(byte *_buffer, unsigned int _size)
+{
+  byte *pos = _buffer;
+  byte *end = _buffer + _size;
+  bool broadcast = (memcmp(target.vendor_id, "*", 1) == 0);
+
+  if (_size < 1) return 0;
+  *pos++ = (type << 6) | (broadcast ? 0x20 : 0) | min((unsigned short)hop, 0x1F);
+
+  pos = WriteBinaryString(pos, end, source.vendor_id);
+  if (pos) pos = WriteBinaryString(pos, end, source.device_id);
+  if (pos) pos = WriteBinaryString(pos, end, source.instance_id);
+
+  if (pos && !broadcast)
+  {
+    pos = WriteBinaryString(pos, end, target.vendor_id);
+    if (pos) pos = WriteBinaryString(pos, end, target.device_id);
+    if (pos) pos = WriteBinaryString(pos, end, target.instance_id);
+  }
+
+  if (pos) pos = WriteBinaryString(pos, end, schema.class_id);
+  if (pos) pos = WriteBinaryString(pos, end, schema.type_id);
+
+  if (pos == NULL || pos >= end) return 0;
+  *pos++ = command_count;
+
+  for (byte i = 0; pos && i < command_count; i++)
+  {
+    pos = WriteBinaryString(pos, end, command[i].name);
+    if (pos) pos = WriteBinaryString(pos, end, command[i].value);
+  }
+
+  return pos ? pos - _buffer : 0;
+}
+
+/**
+ * \brief       Load a binary record created by toBinary
+ * \param    _buffer         the record
+ * \param    _size           length of the record
+ * \return   false if the record is invalid
+ */
+bool xPL_Message::fromBinary(const byte *_buffer, unsigned int _size)
+{
+  const byte *pos = _buffer;
+  const byte *end = _buffer + _size;
+  bool broadcast;
+  byte count;
+  struct_command newcmd;
+
+  if (_size < 1) return false;
+  type = *pos >> 6;
+  broadcast = *pos & 0x20;
+  hop = *pos++ & 0x1F;
+
+  pos = ReadBinaryString(source.vendor_id, pos, end, XPL_VENDOR_ID_MAX);
+  if (pos) pos = ReadBinaryString(source.device_id, pos, end, XPL_DEVICE_ID_MAX);
+  if (pos) pos = ReadBinaryString(source.instance_id, pos, end, XPL_INSTANCE_ID_MAX);
+
+  if (broadcast)
+  {
+    memcpy(target.vendor_id, "*", 2);
+    target.device_id[0] = '\0';
+    target.instance_id[0] = '\0';
+  }
+  else
+  {
+    if (pos) pos = ReadBinaryString(target.vendor_id, pos, end, XPL_VENDOR_ID_MAX);
+    if (pos) pos = ReadBinaryString(target.device_id, pos, end, XPL_DEVICE_ID_MAX);
+    if (pos) pos = ReadBinaryString(target.instance_id, pos, end, XPL_INSTANCE_ID_MAX);
+  }
+
+  if (pos) pos = ReadBinaryString(schema.class_id, pos, end, XPL_CLASS_ID_MAX);
+  if (pos) pos = ReadBinaryString(schema.type_id, pos, end, XPL_TYPE_ID_MAX);
+
+  if (pos == NULL || pos >= end) return false;
+  count = *pos++;
+
+  for (byte i = 0; i < count; i++)
+  {
+    pos = ReadBinaryString(newcmd.name, pos, end, XPL_NAME_LENGTH_MAX);
+    if (pos) pos = ReadBinaryString(newcmd.value, pos, end, XPL_VALUE_LENGTH_MAX);
+    if (pos == NULL || !AddCommand(newcmd.name, newcmd.value)) return false;
+  }
+
+  return true;
+}
+
 bool xPL_Message::IsSchema(char* _classId, char* _typeId)
 {
   if (strcmp(schema.class_id, _classId) == 0)
@@ -196,6 +422,24 @@ bool xPL_Message::IsSchema(char* _classId, char* _typeId)
   return false;
 }
 
+/**
+ * \brief       Get the value of a command
+ * \param    _name         name of the command (PROGMEM)
+ * \return   the value of the first command with this name, NULL if not found
+ */
+char* xPL_Message::GetCommandValue_P(const PROGMEM char* _name)
+{
+  for (byte i = 0; i < command_count; i++)
+  {
+    if (strncmp_P(command[i].name, _name, XPL_NAME_LENGTH_MAX) == 0)
+    {
+      return command[i].value;
+    }
+  }
+
+  return NULL;
+}
+
 /**
  * \brief       Check the message's schema
   * \param   _classId        class
@@ -36,7 +36,19 @@
 #define XPL_TRIG 3
 
 #define XPL_MESSAGE_BUFFER_MAX           256  // going over 256 would mean changing index from byte to int
+#ifndef XPL_MESSAGE_COMMAND_MAX
 #define XPL_MESSAGE_COMMAND_MAX          10
+#endif
+
+// Binary record (toBinary/fromBinary):
+//   byte    type << 6 | broadcast << 5 | hop (0-31, a higher hop count is stored as 31)
+//   string  source vendor, device, instance
+//   string  target vendor, device, instance (not present if broadcast)
+//   string  schema class, type
+//   byte    command count, then name and value strings of each command
+// a string is a length byte followed by the characters, or 0x80 | index of a
+// word of the dictionary (common schemas and names, see xPL_Message.cpp)
+#define XPL_BINARY_DICTIONARY_FLAG       0x80
 
 class xPL_Message
 {
@@ -46,6 +58,7 @@ class xPL_Message
         
 		struct_id source;			// source identification
         struct_id target;			// target identification
+        byte target_group;			// bit of the target group (xpl-group.<name>) when it is one of ours
 
         struct_xpl_schema schema;
         struct_command *command;
@@ -57,10 +70,16 @@ class xPL_Message
         xPL_Message();
         ~xPL_Message();
 
-        char *toString();
+        char *toString();           // deprecated, shared static buffer
+        char *toString(char *);
+
+        unsigned int toBinary(byte *, unsigned int);
+        bool fromBinary(const byte *, unsigned int);
         
         bool IsSchema(char*, char*);
         bool IsSchema_P(const PROGMEM char*, const PROGMEM char*);
+
+        char *GetCommandValue_P(const PROGMEM char *);
 	
 	    void SetSource(char *,char *,char *);  // define my source
 		void SetTarget_P(const PROGMEM char *,const PROGMEM char * = NULL,const PROGMEM char * = NULL);
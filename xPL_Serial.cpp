@@ -0,0 +1,261 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+ 
+#include "xPL_Serial.h"
+
+#define XPL_SERIAL_WAIT_SYNC    0
+#define XPL_SERIAL_LENGTH       1
+#define XPL_SERIAL_RECORD       2
+#define XPL_SERIAL_CRC_HIGH     3
+#define XPL_SERIAL_CRC_LOW      4
+
+/**
+ * \brief       CRC-16/CCITT of one more byte
+ */
+static uint16_t CrcUpdate(uint16_t _crc, byte _data)
+{
+	_crc ^= (uint16_t)_data << 8;
+	for (byte i = 0; i < 8; i++)
+	{
+		_crc = (_crc & 0x8000) ? (_crc << 1) ^ 0x1021 : _crc << 1;
+	}
+	return _crc;
+}
+
+/**
+ * \brief       Serial transport of binary xPL messages
+ * \param    _stream        the serial port
+ * \param    _dePin         RS-485 driver enable pin, high while sending (optional)
+ */
+xPL_Serial::xPL_Serial(Stream * _stream, int8_t _dePin)
+{
+	stream = _stream;
+	de_pin = _dePin;
+
+	ReceiveAction = NULL;
+	errors = 0;
+	state = XPL_SERIAL_WAIT_SYNC;
+	replay_next = 0;
+	replay_end = 0;
+}
+
+/**
+ * \brief       Set up the RS-485 driver enable pin
+ * \details	  To be called in setup(), the pins can't be set up before init()
+ */
+void xPL_Serial::begin()
+{
+	if (de_pin >= 0)
+	{
+		pinMode(de_pin, OUTPUT);
+		digitalWrite(de_pin, LOW);
+	}
+}
+
+/**
+ * \brief       Send an xPL message as a binary frame
+ * \param    _message         an xPL message
+ * \return   false if the message is too long
+ */
+bool xPL_Serial::SendMessage(xPL_Message * _message)
+{
+	byte frame[XPL_SERIAL_RECORD_MAX + 5];
+	unsigned int pos = 1;
+	uint16_t crc = 0xFFFF;
+	unsigned int size = _message->toBinary(frame + 3, XPL_SERIAL_RECORD_MAX);
+
+	if (size == 0)
+		return false;
+
+	frame[0] = XPL_SERIAL_SYNC;
+	if (size < 0x80)
+	{
+		frame[pos++] = size;
+		memmove(frame + 2, frame + 3, size);
+	}
+	else
+	{
+		frame[pos++] = 0x80 | (size & 0x7F);
+		frame[pos++] = size >> 7;
+	}
+
+	for (unsigned int i = 1; i < pos + size; i++)
+	{
+		crc = CrcUpdate(crc, frame[i]);
+	}
+	pos += size;
+	frame[pos++] = crc >> 8;
+	frame[pos++] = crc & 0xFF;
+
+	if (de_pin >= 0) digitalWrite(de_pin, HIGH);
+	stream->write(frame, pos);
+	if (de_pin >= 0)
+	{
+		stream->flush();  // wait for the last byte before releasing the bus
+		digitalWrite(de_pin, LOW);
+	}
+
+	return true;
+}
+
+/**
+ * \brief       Read the available bytes
+ * \details	  To be called in the loop, ReceiveAction is called for each valid frame
+ */
+void xPL_Serial::Process()
+{
+	while (stream->available() > 0)
+	{
+		ReceiveByte(stream->read());
+	}
+}
+
+/**
+ * \brief       Decode a received byte
+ * \details	  A broken frame (e.g. truncated by a reset of the sender) swallows the start
+ *            of the next frames: its data is decoded again from its next sync byte.
+ */
+void xPL_Serial::ReceiveByte(byte _data)
+{
+	DecodeByte(_data);
+
+	while (replay_next < replay_end)
+	{
+		DecodeByte(frame[replay_next++]);
+	}
+}
+
+/**
+ * \brief       Drop the frame being decoded
+ * \details	  Its bytes are replayed, followed by the bytes not replayed yet. A byte is
+ *            always stored before the one being replayed, so the move is in place.
+ */
+void xPL_Serial::FrameError()
+{
+	unsigned int pending = replay_end - replay_next;
+
+	memmove(frame + received, frame + replay_next, pending);
+	replay_next = 0;
+	replay_end = received + pending;
+
+	errors++;
+	state = XPL_SERIAL_WAIT_SYNC;
+}
+
+/**
+ * \brief       Frame decoder state machine
+ */
+void xPL_Serial::DecodeByte(byte _data)
+{
+	if (state == XPL_SERIAL_WAIT_SYNC)
+	{
+		if (_data == XPL_SERIAL_SYNC)
+		{
+			length = 0;
+			shift = 0;
+			header = 0;
+			received = 0;
+			crc = 0xFFFF;
+			state = XPL_SERIAL_LENGTH;
+		}
+		return;
+	}
+
+	frame[received++] = _data;
+
+	switch (state)
+	{
+		case XPL_SERIAL_LENGTH:
+			crc = CrcUpdate(crc, _data);
+			length |= (unsigned int)(_data & 0x7F) << shift;
+			header++;
+
+			if (_data & 0x80)
+			{
+				shift += 7;
+				if (shift > 7)
+				{
+					FrameError();
+				}
+			}
+			else if (length == 0 || length > XPL_SERIAL_RECORD_MAX)
+			{
+				FrameError();
+			}
+			else
+			{
+				state = XPL_SERIAL_RECORD;
+			}
+			break;
+
+		case XPL_SERIAL_RECORD:
+			crc = CrcUpdate(crc, _data);
+			if (received == header + length)
+			{
+				state = XPL_SERIAL_CRC_HIGH;
+			}
+			break;
+
+		case XPL_SERIAL_CRC_HIGH:
+			frame_crc = (uint16_t)_data << 8;
+			state = XPL_SERIAL_CRC_LOW;
+			break;
+
+		case XPL_SERIAL_CRC_LOW:
+			frame_crc |= _data;
+
+			if (frame_crc == crc)
+			{
+				state = XPL_SERIAL_WAIT_SYNC;
+				ReceiveRecord();
+			}
+			else
+			{
+				FrameError();
+			}
+			break;
+	}
+}
+
+/**
+ * \brief       Decode a received record and call the user defined callback
+ */
+void xPL_Serial::ReceiveRecord()
+{
+	xPL_Message message;
+
+	if (!message.fromBinary(frame + header, length))
+	{
+		errors++;
+		return;
+	}
+
+	if (ReceiveAction != NULL)
+	{
+		(*ReceiveAction)(&message);
+	}
+}
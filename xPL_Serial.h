@@ -0,0 +1,79 @@
+/*
+ * xPL.Arduino v0.1, xPL Implementation for Arduino
+ *
+ * This code is parsing a xPL message stored in 'received' buffer
+ * - isolate and store in 'line' buffer each part of the message -> detection of EOL character (DEC 10)
+ * - analyse 'line', function of its number and store information in xpl_header memory
+ * - check for each step if the message respect xPL protocol
+ * - parse each command line
+ *
+ * Copyright (C) 2012 johan@pirlouit.ch, olivier.lebrun@gmail.com
+ * Original version by Gromain59@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef xPLSerial_h
+#define xPLSerial_h
+ 
+#include "Arduino.h"
+#include "xPL_Message.h"
+
+// Frame on the serial line (RS-485/UART):
+//   byte    XPL_SERIAL_SYNC
+//   varint  length of the record (7 bits per byte, high bit = more bytes)
+//   n bytes binary record (see xPL_Message::toBinary)
+//   2 bytes CRC-16/CCITT of length and record, high byte first
+#define XPL_SERIAL_SYNC          0x7E
+#define XPL_SERIAL_RECORD_MAX    XPL_MESSAGE_BUFFER_MAX
+#define XPL_SERIAL_FRAME_MAX     (XPL_SERIAL_RECORD_MAX + 4)   // frame after the sync byte
+
+typedef void (*xPLSerialReceiveAction)(xPL_Message * message);
+
+class xPL_Serial
+{
+    public:
+        xPL_Serial(Stream *, int8_t = -1);
+
+        xPLSerialReceiveAction ReceiveAction;
+        unsigned int errors;        // frame errors (length, CRC or record). Every lost frame is
+                                    // counted, a sync byte in the data of a broken frame may be too
+
+        void begin();
+        bool SendMessage(xPL_Message *);
+        void Process();
+
+    private:
+        Stream *stream;
+        int8_t de_pin;              // RS-485 driver enable pin, -1 = none
+
+        byte state;
+        byte shift;
+        byte header;                // length bytes of the frame
+        unsigned int length;
+        unsigned int received;      // bytes of the frame since the sync byte
+        uint16_t crc;
+        uint16_t frame_crc;
+        byte frame[XPL_SERIAL_FRAME_MAX];
+        unsigned int replay_next;   // bytes of a broken frame to decode again
+        unsigned int replay_end;
+
+        void ReceiveByte(byte);
+        void DecodeByte(byte);
+        void FrameError();
+        void ReceiveRecord();
+};
+
+#endif
@@ -36,3 +36,32 @@ void clearStr (char* str)
         str[c] = 0;
     }
 }
+
+/**
+ * \brief       Copy a field up to its delimiter
+ * \details	  Replaces the "%8[^-]-" sscanf patterns: the field is copied
+ *            until 'delimiter' is found, and rejected if longer than 'max'.
+ * \param    dest           destination buffer, at least max+1 bytes
+ * \param    src            string to scan
+ * \param    delimiter      end of field character ('\0' for the last field)
+ * \param    max            maximum length of the field
+ * \return   position following the delimiter, NULL if the field is invalid
+ *            (dest is still terminated, with the truncated field)
+ */
+char* scanField (char* dest, char* src, char delimiter, byte max)
+{
+    byte i = 0;
+    while (src[i] != delimiter)
+    {
+        if (src[i] == '\0' || i == max)
+        {
+            dest[i] = '\0';
+            return NULL;
+        }
+        dest[i] = src[i];
+        i++;
+    }
+    dest[i] = '\0';
+
+    return src + i + 1;
+}
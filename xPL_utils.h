@@ -37,13 +37,18 @@
 #define	XPL_CLASS_ID_MAX		8
 #define	XPL_TYPE_ID_MAX			8
 #define XPL_NAME_LENGTH_MAX		16
+#ifndef XPL_VALUE_LENGTH_MAX
 #define XPL_VALUE_LENGTH_MAX	32  // should be 128 but need to spare RAM
+#endif
+
+#if XPL_VALUE_LENGTH_MAX < XPL_INSTANCE_ID_MAX + 10
+#error XPL_VALUE_LENGTH_MAX must be XPL_INSTANCE_ID_MAX + 10 or more ("xpl-group.<name>" in the config.current answer)
+#endif
+#if XPL_VALUE_LENGTH_MAX > 127
+#error XPL_VALUE_LENGTH_MAX must be 127 or less (length byte of the binary format, 0x80 is XPL_BINARY_DICTIONARY_FLAG)
+#endif
 
-#define	XPL_HOP_COUNT_PARSER	PSTR("hop=%d")
-#define	XPL_SOURCE_PARSER		PSTR("source=%8[^-]-%8[^'.'].%16s")
-#define	XPL_TARGET_PARSER		PSTR("target=%8[^-]-%8[^'.'].%16s")
-#define	XPL_SCHEMA_PARSER		PSTR("%8[^'.'].%8s")
-#define XPL_COMMAND_PARSER		PSTR("%16[^'=']=%32s")    // 32 shall match XPL_VALUE_LENGTH_MAX
+#define	XPL_HOP_COUNT_PARSER	PSTR("hop=%hd")  // xPL_Message::hop is a short
 
 typedef struct struct_id struct_id;
 struct struct_id			// source or target
@@ -67,6 +72,15 @@ struct struct_command			// source or target
     char value[XPL_VALUE_LENGTH_MAX+1];		// device id
 };
 
+typedef struct struct_xpl_filter struct_xpl_filter;
+struct struct_xpl_filter		// msgtype.vendor.device.instance.class.type, "*" matches anything
+{
+    byte type;						// 0=any, 1=cmnd, 2=stat, 3=trig
+    struct_id source;
+    struct_xpl_schema schema;
+};
+
 void clearStr (char* str);
+char* scanField (char* dest, char* src, char delimiter, byte max);
 
 #endif